@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+
+// Returns whether the axis aligned box [min, max] is outside of the view frustum, to_clip mapping the box coordinates
+// to clip space. The box is outside if all of its corners are beyond the same clip plane. Boxes near a frustum edge
+// may be reported as inside, never the other way around.
+inline bool is_box_outside_frustum(const glm::mat4& to_clip, const glm::vec3& min, const glm::vec3& max)
+{
+	int outside[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		glm::vec4 point = to_clip * glm::vec4(corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y,
+			corner & 4 ? max.z : min.z, 1.0f);
+		outside[0] += point.x < -point.w;
+		outside[1] += point.x > point.w;
+		outside[2] += point.y < -point.w;
+		outside[3] += point.y > point.w;
+		outside[4] += point.z < -point.w;
+		outside[5] += point.z > point.w;
+	}
+	return std::find(outside, outside + 6, 8) != outside + 6;
+}
@@ -0,0 +1,164 @@
+#include "Height_grid.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+using namespace std;
+
+
+namespace
+{
+	// in cells, how far past the far edges of the grid a point may lie because of rounding
+	const double EDGE_TOLERANCE = 1e-9;
+}
+
+// Creates an empty grid without cells
+Height_grid::Height_grid() :
+	origin_x(0.0), origin_y(0.0), cell_size(1.0), cols(0), rows(0)
+{
+}
+
+// Creates a grid of cols x rows square cells whose first cell starts at (origin_x, origin_y)
+Height_grid::Height_grid(double origin_x, double origin_y, double cell_size, size_t cols, size_t rows) :
+	origin_x(origin_x), origin_y(origin_y), cell_size(cell_size), cols(cols), rows(rows),
+	heights(cols * rows, numeric_limits<double>::quiet_NaN())
+{
+}
+
+// Replaces every cell height by the mean height of the points inside the cell. Points outside the grid are ignored,
+// points on its far edges belong to the last column or row.
+void Height_grid::set_points(const vector<glm::dvec3>& points)
+{
+	const size_t outside = numeric_limits<size_t>::max();
+	if (cols == 0 || rows == 0)
+	{
+		return;
+	}
+
+	// the grid is split into one band of rows per worker
+	size_t workers = get_worker_count();
+	size_t band_rows = (rows + workers - 1) / workers;
+	size_t bands = (rows + band_rows - 1) / band_rows;
+
+	// 1. find the cell of every point and count the points per band and worker
+	vector<size_t> point_cells(points.size());
+	vector<vector<size_t>> band_counts(workers, vector<size_t>(bands, 0));
+	parallel_for(0, points.size(), [&](size_t begin, size_t end, size_t worker)
+	{
+		vector<size_t>& counts = band_counts[worker];
+		for (size_t i = begin; i < end; ++i)
+		{
+			double col = floor((points[i].x - origin_x) / cell_size);
+			double row = floor((points[i].y - origin_y) / cell_size);
+			// the far edges belong to the last column and row, e.g. points on the maximum of a survey overlap
+			// whose extent is a multiple of the cell size
+			if (col == cols && (points[i].x - origin_x) / cell_size <= cols + EDGE_TOLERANCE)
+			{
+				col = cols - 1.0;
+			}
+			if (row == rows && (points[i].y - origin_y) / cell_size <= rows + EDGE_TOLERANCE)
+			{
+				row = rows - 1.0;
+			}
+			if (col < 0.0 || row < 0.0 || col >= cols || row >= rows)
+			{
+				point_cells[i] = outside;
+			}
+			else
+			{
+				point_cells[i] = size_t(row) * cols + size_t(col);
+				counts[size_t(row) / band_rows]++;
+			}
+		}
+	});
+
+	// 2. sort the points by band: every worker writes its points behind those of the previous workers in each band.
+	// parallel_for hands out the same chunks again, so the counts of a worker match its chunk.
+	vector<size_t> band_starts(bands + 1, 0);
+	for (size_t band = 0; band < bands; ++band)
+	{
+		size_t offset = band_starts[band];
+		for (size_t worker = 0; worker < workers; ++worker)
+		{
+			size_t count = band_counts[worker][band];
+			band_counts[worker][band] = offset;
+			offset += count;
+		}
+		band_starts[band + 1] = offset;
+	}
+	vector<pair<size_t, double>> band_points(band_starts[bands]);
+	parallel_for(0, points.size(), [&](size_t begin, size_t end, size_t worker)
+	{
+		vector<size_t>& offsets = band_counts[worker];
+		for (size_t i = begin; i < end; ++i)
+		{
+			size_t cell = point_cells[i];
+			if (cell != outside)
+			{
+				band_points[offsets[cell / cols / band_rows]++] = make_pair(cell, points[i].z);
+			}
+		}
+	});
+	vector<size_t>().swap(point_cells);
+
+	// 3. every worker accumulates the points of its own band, so the cells can be updated without locking
+	vector<unsigned int> counts(heights.size(), 0);
+	parallel_for(0, bands, [&](size_t begin, size_t end, size_t)
+	{
+		size_t first_cell = begin * band_rows * cols;
+		size_t last_cell = min(end * band_rows, rows) * cols;
+		fill(heights.begin() + first_cell, heights.begin() + last_cell, 0.0);
+		for (size_t i = band_starts[begin]; i < band_starts[end]; ++i)
+		{
+			heights[band_points[i].first] += band_points[i].second;
+			counts[band_points[i].first]++;
+		}
+		for (size_t cell = first_cell; cell < last_cell; ++cell)
+		{
+			heights[cell] = counts[cell] > 0 ? heights[cell] / counts[cell] : numeric_limits<double>::quiet_NaN();
+		}
+	}, 1);
+}
+
+bool Height_grid::has_height(size_t col, size_t row) const
+{
+	return !isnan(heights[row * cols + col]);
+}
+
+double Height_grid::get_height(size_t col, size_t row) const
+{
+	return heights[row * cols + col];
+}
+
+glm::dvec2 Height_grid::get_cell_center(size_t col, size_t row) const
+{
+	return glm::dvec2(origin_x + (col + 0.5) * cell_size, origin_y + (row + 0.5) * cell_size);
+}
+
+double Height_grid::get_origin_x() const
+{
+	return origin_x;
+}
+
+double Height_grid::get_origin_y() const
+{
+	return origin_y;
+}
+
+double Height_grid::get_cell_size() const
+{
+	return cell_size;
+}
+
+size_t Height_grid::get_cols() const
+{
+	return cols;
+}
+
+size_t Height_grid::get_rows() const
+{
+	return rows;
+}
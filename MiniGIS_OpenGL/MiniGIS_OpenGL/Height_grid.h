@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// A regular grid of terrain heights. The height of a cell is the mean height of the points that fall into it,
+// cells without any point have no height.
+class Height_grid
+{
+public:
+	// Creates an empty grid without cells
+	Height_grid();
+	// Creates a grid of cols x rows square cells whose first cell starts at (origin_x, origin_y)
+	Height_grid(double origin_x, double origin_y, double cell_size, size_t cols, size_t rows);
+
+	// Replaces every cell height by the mean height of the points inside the cell. Points outside the grid are ignored,
+	// points on its far edges belong to the last column or row.
+	void set_points(const std::vector<glm::dvec3>& points);
+
+	bool has_height(size_t col, size_t row) const;
+	double get_height(size_t col, size_t row) const;
+	glm::dvec2 get_cell_center(size_t col, size_t row) const;
+
+	double get_origin_x() const;
+	double get_origin_y() const;
+	double get_cell_size() const;
+	size_t get_cols() const;
+	size_t get_rows() const;
+
+private:
+	double origin_x;
+	double origin_y;
+	double cell_size;
+	size_t cols;
+	size_t rows;
+	// row-major heights, NaN for cells without points
+	std::vector<double> heights;
+};
@@ -0,0 +1,215 @@
+#include "Las_reader.h"
+#include "Parallel.h"
+
+#include <cstring>
+#include <iostream>
+#define NOMINMAX
+#include <windows.h>
+
+using namespace std;
+
+
+namespace
+{
+	// offsets into the public header block
+	const size_t HEADER_VERSION_MINOR = 25;
+	const size_t HEADER_SIZE = 94;
+	const size_t HEADER_POINT_DATA_OFFSET = 96;
+	const size_t HEADER_POINT_FORMAT = 104;
+	const size_t HEADER_POINT_RECORD_LENGTH = 105;
+	const size_t HEADER_LEGACY_POINT_COUNT = 107;
+	const size_t HEADER_SCALE = 131;
+	const size_t HEADER_OFFSET = 155;
+	const size_t HEADER_POINT_COUNT = 247;
+	const size_t HEADER_SIZE_1_4 = 375;
+
+	template <typename T>
+	T read_value(const unsigned char* data, size_t offset)
+	{
+		// LAS is little endian, as is every platform the viewer runs on
+		T value;
+		memcpy(&value, data + offset, sizeof(T));
+		return value;
+	}
+
+	// Read-only memory mapping of a whole file
+	class Mapped_file
+	{
+	public:
+		explicit Mapped_file(const string& path) :
+			file(INVALID_HANDLE_VALUE), mapping(nullptr), data(nullptr), size(0)
+		{
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			LARGE_INTEGER file_size;
+			if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+			{
+				return;
+			}
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping == nullptr)
+			{
+				return;
+			}
+			data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (data != nullptr)
+			{
+				size = size_t(file_size.QuadPart);
+			}
+		}
+
+		~Mapped_file()
+		{
+			if (data != nullptr)
+			{
+				UnmapViewOfFile(data);
+			}
+			if (mapping != nullptr)
+			{
+				CloseHandle(mapping);
+			}
+			if (file != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(file);
+			}
+		}
+
+		Mapped_file(const Mapped_file&) = delete;
+		Mapped_file& operator=(const Mapped_file&) = delete;
+
+		const unsigned char* get_data() const
+		{
+			return data;
+		}
+
+		size_t get_size() const
+		{
+			return size;
+		}
+
+	private:
+		HANDLE file;
+		HANDLE mapping;
+		const unsigned char* data;
+		size_t size;
+	};
+}
+
+// Reads an uncompressed LAS 1.2 - 1.4 file with point data format 0 - 10. The file is memory mapped and the point
+// records are decoded in parallel chunks, applying the scale and offset of the header. A non-empty classes list
+// keeps only the points of these classifications (e.g. 2 for ground). Returns no points if the file cannot be read.
+Las_points read_las(const string& path, const vector<uint8_t>& classes)
+{
+	Las_points points;
+	Mapped_file file(path);
+	const unsigned char* data = file.get_data();
+	if (data == nullptr || file.get_size() < HEADER_SCALE + 48 || memcmp(data, "LASF", 4) != 0)
+	{
+		cout << "Failed to open LAS file: " << path << endl;
+		return points;
+	}
+
+	uint8_t version_minor = read_value<uint8_t>(data, HEADER_VERSION_MINOR);
+	uint16_t header_size = read_value<uint16_t>(data, HEADER_SIZE);
+	size_t point_data_offset = read_value<uint32_t>(data, HEADER_POINT_DATA_OFFSET);
+	uint8_t point_format = read_value<uint8_t>(data, HEADER_POINT_FORMAT);
+	size_t record_length = read_value<uint16_t>(data, HEADER_POINT_RECORD_LENGTH);
+	uint64_t point_count = read_value<uint32_t>(data, HEADER_LEGACY_POINT_COUNT);
+	if (version_minor >= 4 && header_size >= HEADER_SIZE_1_4 && file.get_size() >= HEADER_SIZE_1_4)
+	{
+		uint64_t extended_count = read_value<uint64_t>(data, HEADER_POINT_COUNT);
+		if (extended_count > 0)
+		{
+			point_count = extended_count;
+		}
+	}
+
+	// the two high bits of the format mark LAZ compressed points
+	if ((point_format & 0xC0) != 0)
+	{
+		cout << "Compressed LAZ files are not supported: " << path << endl;
+		return points;
+	}
+	// formats 6 - 10 have a full byte classification after the return and flag bytes
+	size_t classification_offset = point_format >= 6 ? 16 : 15;
+	uint8_t classification_mask = point_format >= 6 ? 0xFF : 0x1F;
+	if (point_format > 10 || record_length < classification_offset + 1 || point_data_offset > file.get_size())
+	{
+		cout << "Unsupported LAS point format " << int(point_format) << ": " << path << endl;
+		return points;
+	}
+	point_count = std::min<uint64_t>(point_count, (file.get_size() - point_data_offset) / record_length);
+
+	glm::dvec3 scale(read_value<double>(data, HEADER_SCALE), read_value<double>(data, HEADER_SCALE + 8),
+		read_value<double>(data, HEADER_SCALE + 16));
+	glm::dvec3 offset(read_value<double>(data, HEADER_OFFSET), read_value<double>(data, HEADER_OFFSET + 8),
+		read_value<double>(data, HEADER_OFFSET + 16));
+	const unsigned char* records = data + point_data_offset;
+
+	bool keep_class[256];
+	for (int i = 0; i < 256; ++i)
+	{
+		keep_class[i] = classes.empty();
+	}
+	for (uint8_t point_class : classes)
+	{
+		keep_class[point_class] = true;
+	}
+	auto get_class = [&](size_t i)
+	{
+		return uint8_t(records[i * record_length + classification_offset] & classification_mask);
+	};
+
+	// 1. with a filter every chunk counts its points first, so that it knows where to write them.
+	// parallel_for splits the same range into the same chunks on every call.
+	size_t count = size_t(point_count);
+	vector<size_t> chunk_offsets(get_worker_count() + 1, 0);
+	if (classes.empty())
+	{
+		parallel_for(0, count, [&](size_t begin, size_t end, size_t worker)
+		{
+			chunk_offsets[worker + 1] = end - begin;
+		});
+	}
+	else
+	{
+		parallel_for(0, count, [&](size_t begin, size_t end, size_t worker)
+		{
+			size_t kept = 0;
+			for (size_t i = begin; i < end; ++i)
+			{
+				kept += keep_class[get_class(i)] ? 1 : 0;
+			}
+			chunk_offsets[worker + 1] = kept;
+		});
+	}
+	for (size_t i = 1; i < chunk_offsets.size(); ++i)
+	{
+		chunk_offsets[i] += chunk_offsets[i - 1];
+	}
+
+	// 2. decode
+	size_t kept_count = chunk_offsets.back();
+	points.positions.resize(kept_count);
+	points.intensities.resize(kept_count);
+	points.classifications.resize(kept_count);
+	parallel_for(0, count, [&](size_t begin, size_t end, size_t worker)
+	{
+		size_t out = chunk_offsets[worker];
+		for (size_t i = begin; i < end; ++i)
+		{
+			uint8_t point_class = get_class(i);
+			if (!keep_class[point_class])
+			{
+				continue;
+			}
+			const unsigned char* record = records + i * record_length;
+			glm::dvec3 position(read_value<int32_t>(record, 0), read_value<int32_t>(record, 4), read_value<int32_t>(record, 8));
+			points.positions[out] = position * scale + offset;
+			points.intensities[out] = read_value<uint16_t>(record, 12);
+			points.classifications[out] = point_class;
+			out++;
+		}
+	});
+	return points;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Points of a LAS file with their intensity and classification, all three of the same length
+struct Las_points
+{
+	std::vector<glm::dvec3> positions;
+	std::vector<uint16_t> intensities;
+	std::vector<uint8_t> classifications;
+};
+
+// Reads an uncompressed LAS 1.2 - 1.4 file with point data format 0 - 10. The file is memory mapped and the point
+// records are decoded in parallel chunks, applying the scale and offset of the header. A non-empty classes list
+// keeps only the points of these classifications (e.g. 2 for ground). Returns no points if the file cannot be read.
+Las_points read_las(const std::string& path, const std::vector<uint8_t>& classes = std::vector<uint8_t>());
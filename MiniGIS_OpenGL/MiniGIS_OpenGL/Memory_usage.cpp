@@ -0,0 +1,35 @@
+#include "Memory_usage.h"
+
+#include <iostream>
+#include <windows.h>
+#include <psapi.h>
+
+using namespace std;
+
+
+// Returns the current memory usage of the process, zeros if it cannot be queried
+Memory_usage get_memory_usage()
+{
+	Memory_usage usage;
+	PROCESS_MEMORY_COUNTERS counters;
+	// the kernel32 entry point, so psapi.lib does not have to be linked
+	if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return usage;
+	}
+	usage.working_set = counters.WorkingSetSize;
+	usage.peak_working_set = counters.PeakWorkingSetSize;
+	usage.committed = counters.PagefileUsage;
+	usage.peak_committed = counters.PeakPagefileUsage;
+	return usage;
+}
+
+// Prints the current and peak memory usage after a stage of loading
+void report_memory(const char* stage)
+{
+	const double MB = 1024.0 * 1024.0;
+	Memory_usage usage = get_memory_usage();
+	cout << "memory after " << stage << ": working set " << usage.working_set / MB << " MB (peak "
+		<< usage.peak_working_set / MB << " MB), committed " << usage.committed / MB << " MB (peak "
+		<< usage.peak_committed / MB << " MB)" << endl;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+// Memory of the process in bytes. The working set is what is resident in RAM, the committed memory is what the
+// process allocated, whether resident or paged out. The peaks are process wide and never decrease.
+struct Memory_usage
+{
+	size_t working_set = 0;
+	size_t peak_working_set = 0;
+	size_t committed = 0;
+	size_t peak_committed = 0;
+};
+
+// Returns the current memory usage of the process, zeros if it cannot be queried
+Memory_usage get_memory_usage();
+
+// Prints the current and peak memory usage after a stage of loading
+void report_memory(const char* stage);
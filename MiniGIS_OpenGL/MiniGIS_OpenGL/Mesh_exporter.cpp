@@ -0,0 +1,217 @@
+#include "Mesh_exporter.h"
+#include "Mesh_index.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+using namespace std;
+
+
+namespace
+{
+	// bytes every worker encodes before the batch is written
+	const size_t BATCH_BYTES = 16 << 20;
+
+	// Encodes count items of item_size bytes each in parallel batches with encode(begin, end, out) and writes
+	// the batches in order, so the memory use stays bounded for any mesh size
+	template <typename Encode>
+	void write_encoded(ofstream& out, size_t count, size_t item_size, Encode encode)
+	{
+		size_t worker_items = std::max<size_t>(1, BATCH_BYTES / item_size);
+		size_t batch_items = worker_items * get_worker_count();
+		vector<vector<char>> buffers(get_worker_count());
+		for (size_t first = 0; first < count && out; first += batch_items)
+		{
+			for (vector<char>& buffer : buffers)
+			{
+				buffer.clear();
+			}
+			parallel_for(first, std::min(count, first + batch_items), [&](size_t begin, size_t end, size_t worker)
+			{
+				buffers[worker].resize((end - begin) * item_size);
+				encode(begin, end, buffers[worker].data());
+			}, worker_items);
+			// chunks of lower workers come first
+			for (const vector<char>& buffer : buffers)
+			{
+				out.write(buffer.data(), buffer.size());
+			}
+		}
+	}
+
+	// The positions of the mesh are in world units relative to origin. They are written as double world coordinates,
+	// PLY has no transform that readers would apply.
+	void write_ply(ofstream& out, const Indexed_mesh& mesh, const vector<glm::vec3>& normals, const glm::dvec3& origin)
+	{
+		out << "ply\n"
+			<< "format binary_little_endian 1.0\n"
+			<< "comment generated by MiniGIS_OpenGL\n"
+			<< "element vertex " << mesh.positions.size() << "\n"
+			<< "property double x\n"
+			<< "property double y\n"
+			<< "property double z\n"
+			<< "property float nx\n"
+			<< "property float ny\n"
+			<< "property float nz\n"
+			<< "element face " << mesh.indices.size() / 3 << "\n"
+			<< "property list uchar uint vertex_indices\n"
+			<< "end_header\n";
+
+		const size_t vertex_size = 3 * sizeof(double) + 3 * sizeof(float);
+		write_encoded(out, mesh.positions.size(), vertex_size, [&](size_t begin, size_t end, char* data)
+		{
+			for (size_t i = begin; i < end; ++i, data += vertex_size)
+			{
+				double position[3] = { origin.x + mesh.positions[i].x, origin.y + mesh.positions[i].y, origin.z + mesh.positions[i].z };
+				memcpy(data, position, 3 * sizeof(double));
+				memcpy(data + 3 * sizeof(double), &normals[i], 3 * sizeof(float));
+			}
+		});
+
+		const size_t face_size = 1 + 3 * sizeof(uint32_t);
+		write_encoded(out, mesh.indices.size() / 3, face_size, [&](size_t begin, size_t end, char* data)
+		{
+			for (size_t i = begin; i < end; ++i, data += face_size)
+			{
+				data[0] = 3;
+				memcpy(data + 1, &mesh.indices[3 * i], 3 * sizeof(uint32_t));
+			}
+		});
+	}
+
+	// Returns false without writing anything if the file would exceed the 32 bit lengths of the glb header
+	bool write_glb(ofstream& out, const Indexed_mesh& mesh, const vector<glm::vec3>& normals,
+		const glm::dvec3& scale, const glm::dvec3& translation)
+	{
+		static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "positions and normals are written as tightly packed VEC3");
+
+		glm::vec3 min(numeric_limits<float>::max());
+		glm::vec3 max(-numeric_limits<float>::max());
+		for (const glm::vec3& position : mesh.positions)
+		{
+			min = glm::min(min, position);
+			max = glm::max(max, position);
+		}
+
+		size_t attribute_bytes = mesh.positions.size() * sizeof(glm::vec3);
+		size_t index_bytes = mesh.indices.size() * sizeof(uint32_t);
+		size_t binary_bytes = 2 * attribute_bytes + index_bytes;
+
+		// the terrain is z up, glTF is y up: the root node turns the georeferenced child node upright
+		ostringstream json;
+		json << setprecision(17)
+			<< "{\"asset\":{\"version\":\"2.0\",\"generator\":\"MiniGIS_OpenGL\"},"
+			<< "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+			<< "\"nodes\":[{\"children\":[1],\"rotation\":[-0.70710678118654752,0,0,0.70710678118654752]},"
+			<< "{\"mesh\":0,\"translation\":[" << translation.x << "," << translation.y << "," << translation.z << "],"
+			<< "\"scale\":[" << scale.x << "," << scale.y << "," << scale.z << "]}],"
+			<< "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2}]}],"
+			<< "\"buffers\":[{\"byteLength\":" << binary_bytes << "}],"
+			<< "\"bufferViews\":["
+			<< "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << attribute_bytes << ",\"target\":34962},"
+			<< "{\"buffer\":0,\"byteOffset\":" << attribute_bytes << ",\"byteLength\":" << attribute_bytes << ",\"target\":34962},"
+			<< "{\"buffer\":0,\"byteOffset\":" << 2 * attribute_bytes << ",\"byteLength\":" << index_bytes << ",\"target\":34963}],"
+			<< "\"accessors\":["
+			<< "{\"bufferView\":0,\"componentType\":5126,\"count\":" << mesh.positions.size() << ",\"type\":\"VEC3\","
+			<< "\"min\":[" << min.x << "," << min.y << "," << min.z << "],\"max\":[" << max.x << "," << max.y << "," << max.z << "]},"
+			<< "{\"bufferView\":1,\"componentType\":5126,\"count\":" << normals.size() << ",\"type\":\"VEC3\"},"
+			<< "{\"bufferView\":2,\"componentType\":5125,\"count\":" << mesh.indices.size() << ",\"type\":\"SCALAR\"}]}";
+		string json_chunk = json.str();
+		// chunks are 4 byte aligned, JSON is padded with spaces and binary data with zeros
+		json_chunk.append((4 - json_chunk.size() % 4) % 4, ' ');
+		size_t binary_padding = (4 - binary_bytes % 4) % 4;
+		size_t file_bytes = 12 + 8 + json_chunk.size() + 8 + binary_bytes + binary_padding;
+		if (file_bytes > numeric_limits<uint32_t>::max())
+		{
+			return false;
+		}
+
+		uint32_t header[3] = { 0x46546C67, 2, uint32_t(file_bytes) };
+		uint32_t json_header[2] = { uint32_t(json_chunk.size()), 0x4E4F534A };
+		uint32_t binary_header[2] = { uint32_t(binary_bytes + binary_padding), 0x004E4942 };
+		out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(json_header), sizeof(json_header));
+		out.write(json_chunk.data(), json_chunk.size());
+		out.write(reinterpret_cast<const char*>(binary_header), sizeof(binary_header));
+
+		// the buffers already have the layout of the binary chunk
+		out.write(reinterpret_cast<const char*>(mesh.positions.data()), attribute_bytes);
+		out.write(reinterpret_cast<const char*>(normals.data()), attribute_bytes);
+		out.write(reinterpret_cast<const char*>(mesh.indices.data()), index_bytes);
+		const char padding[4] = { 0, 0, 0, 0 };
+		out.write(padding, binary_padding);
+		return true;
+	}
+}
+
+// Writes a triangle soup (stride floats per vertex, position first) as an indexed mesh with smooth normals.
+// Positions are the normalized [-1, 1] viewer positions, bounds_min / bounds_max the world extent they were scaled
+// from. PLY gets world coordinates in double, glb keeps the normalized positions under a node that scales and
+// translates them back.
+// The format follows the extension: binary little endian PLY (.ply) or binary glTF 2.0 (.glb).
+// Returns false and reports the reason if the file could not be written.
+bool export_mesh(const string& path, const vector<float>& vertices, size_t stride,
+	const glm::dvec3& bounds_min, const glm::dvec3& bounds_max)
+{
+	string extension = path.substr(std::min(path.size(), path.find_last_of('.')));
+	transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(tolower(c)); });
+	if (extension != ".ply" && extension != ".glb")
+	{
+		cout << "Unknown export format, use .ply or .glb: " << path << endl;
+		return false;
+	}
+
+	auto start = chrono::steady_clock::now();
+	Indexed_mesh mesh = index_vertices(vertices, stride);
+	orient_upwards(mesh);
+	if (mesh.indices.empty())
+	{
+		cout << "Nothing to export, the mesh has no triangles: " << path << endl;
+		return false;
+	}
+	// world = position * scale + translation undoes the scaling to [-1, 1]
+	glm::dvec3 scale = (bounds_max - bounds_min) / 2.0;
+	glm::dvec3 translation = (bounds_max + bounds_min) / 2.0;
+
+	ofstream out(path, ios::binary);
+	if (extension == ".ply")
+	{
+		// the axes were scaled to [-1, 1] by different factors, so the normals are taken from the world geometry.
+		// The translation is left out until writing, georeferenced coordinates do not fit into a float.
+		for (glm::vec3& position : mesh.positions)
+		{
+			position = glm::vec3(glm::dvec3(position) * scale);
+		}
+		write_ply(out, mesh, compute_vertex_normals(mesh), translation);
+	}
+	else if (!write_glb(out, mesh, compute_vertex_normals(mesh), scale, translation))
+	{
+		out.close();
+		remove(path.c_str());
+		cout << "Mesh is too large for .glb, whose chunks are limited to 4 GB, export it as .ply instead: " << path << endl;
+		return false;
+	}
+	out.close();
+	if (!out)
+	{
+		cout << "Failed to write mesh: " << path << endl;
+		return false;
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	ifstream written(path, ios::binary | ios::ate);
+	double megabytes = double(written.tellg()) / (1024.0 * 1024.0);
+	cout << "exported " << mesh.positions.size() << " vertices and " << mesh.indices.size() / 3 << " triangles to "
+		<< path << ": " << megabytes << " MB in " << seconds * 1000.0 << " ms (" << megabytes / seconds << " MB/s)" << endl;
+	return true;
+}
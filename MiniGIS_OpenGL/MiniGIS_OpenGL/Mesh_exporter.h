@@ -0,0 +1,15 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Writes a triangle soup (stride floats per vertex, position first) as an indexed mesh with smooth normals.
+// Positions are the normalized [-1, 1] viewer positions, bounds_min / bounds_max the world extent they were scaled
+// from. PLY gets world coordinates in double, glb keeps the normalized positions under a node that scales and
+// translates them back.
+// The format follows the extension: binary little endian PLY (.ply) or binary glTF 2.0 (.glb).
+// Returns false and reports the reason if the file could not be written.
+bool export_mesh(const std::string& path, const std::vector<float>& vertices, size_t stride,
+	const glm::dvec3& bounds_min, const glm::dvec3& bounds_max);
@@ -0,0 +1,109 @@
+#include "Mesh_index.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+using namespace std;
+
+
+namespace
+{
+	// Bit pattern of a position, so that only identical positions are welded
+	struct Position_key
+	{
+		uint32_t bits[3];
+
+		bool operator==(const Position_key& other) const
+		{
+			return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+		}
+	};
+
+	struct Position_hash
+	{
+		size_t operator()(const Position_key& key) const
+		{
+			uint64_t hash = key.bits[0];
+			hash = hash * 0x9E3779B97F4A7C15ull ^ key.bits[1];
+			hash = hash * 0x9E3779B97F4A7C15ull ^ key.bits[2];
+			return size_t(hash ^ (hash >> 32));
+		}
+	};
+}
+
+// Welds the vertices of a triangle soup (stride floats per vertex, position first) that share the same position
+Indexed_mesh index_vertices(const vector<float>& vertices, size_t stride)
+{
+	Indexed_mesh mesh;
+	size_t vertex_count = vertices.size() / stride;
+	mesh.indices.resize(vertex_count);
+
+	unordered_map<Position_key, unsigned int, Position_hash> lookup;
+	// every position of a closed surface is shared by about six triangles
+	lookup.reserve(vertex_count / 4 + 1);
+	mesh.positions.reserve(vertex_count / 4 + 1);
+	for (size_t i = 0; i < vertex_count; ++i)
+	{
+		const float* position = &vertices[i * stride];
+		Position_key key;
+		memcpy(key.bits, position, sizeof(key.bits));
+		auto inserted = lookup.emplace(key, (unsigned int)mesh.positions.size());
+		if (inserted.second)
+		{
+			mesh.positions.push_back(glm::vec3(position[0], position[1], position[2]));
+		}
+		mesh.indices[i] = inserted.first->second;
+	}
+	return mesh;
+}
+
+// Turns every triangle so that its normal points towards +z. The facets of the reconstruction are not consistently
+// oriented, and facing up is the right orientation for terrain. Turning swaps the last two indices of a triangle,
+// so indices no longer follow the order of the soup.
+void orient_upwards(Indexed_mesh& mesh)
+{
+	parallel_for(0, mesh.indices.size() / 3, [&](size_t begin, size_t end, size_t)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			unsigned int* triangle = &mesh.indices[3 * i];
+			const glm::vec3& a = mesh.positions[triangle[0]];
+			glm::vec3 n = glm::cross(mesh.positions[triangle[1]] - a, mesh.positions[triangle[2]] - a);
+			if (n.z < 0.0f)
+			{
+				swap(triangle[1], triangle[2]);
+			}
+		}
+	});
+}
+
+// Area weighted vertex normals of the mesh
+vector<glm::vec3> compute_vertex_normals(const Indexed_mesh& mesh)
+{
+	vector<glm::vec3> normals(mesh.positions.size(), glm::vec3(0.0f));
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const glm::vec3& a = mesh.positions[mesh.indices[i]];
+		const glm::vec3& b = mesh.positions[mesh.indices[i + 1]];
+		const glm::vec3& c = mesh.positions[mesh.indices[i + 2]];
+		// the cross product is as long as twice the triangle area
+		glm::vec3 n = glm::cross(b - a, c - a);
+		for (int j = 0; j < 3; ++j)
+		{
+			normals[mesh.indices[i + j]] += n;
+		}
+	}
+
+	parallel_for(0, normals.size(), [&](size_t begin, size_t end, size_t)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			float length = glm::length(normals[i]);
+			normals[i] = length > 0.0f ? normals[i] / length : glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+	});
+	return normals;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// A triangle mesh whose vertices are shared between the triangles that use them
+struct Indexed_mesh
+{
+	std::vector<glm::vec3> positions;
+	// three indices into positions per triangle
+	std::vector<unsigned int> indices;
+};
+
+// Welds the vertices of a triangle soup (stride floats per vertex, position first) that share the same position
+Indexed_mesh index_vertices(const std::vector<float>& vertices, size_t stride);
+
+// Turns every triangle so that its normal points towards +z. The facets of the reconstruction are not consistently
+// oriented, and facing up is the right orientation for terrain. Turning swaps the last two indices of a triangle,
+// so indices no longer follow the order of the soup.
+void orient_upwards(Indexed_mesh& mesh);
+
+// Area weighted vertex normals of the mesh
+std::vector<glm::vec3> compute_vertex_normals(const Indexed_mesh& mesh);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Number of threads the parallel loops are split between
+inline size_t get_worker_count()
+{
+	size_t count = std::thread::hardware_concurrency();
+	return count == 0 ? 1 : count;
+}
+
+// Splits [begin, end) into one contiguous chunk per worker and calls func(chunk_begin, chunk_end, worker) for every chunk.
+// worker is always smaller than get_worker_count(), so callers can keep per-worker partial results without locking.
+// Ranges shorter than min_chunk per worker are processed by fewer threads.
+template <typename Function>
+void parallel_for(size_t begin, size_t end, Function func, size_t min_chunk = 4096)
+{
+	if (end <= begin)
+	{
+		return;
+	}
+
+	size_t count = end - begin;
+	min_chunk = std::max<size_t>(min_chunk, 1);
+	size_t workers = std::min(get_worker_count(), (count + min_chunk - 1) / min_chunk);
+	if (workers <= 1)
+	{
+		func(begin, end, size_t(0));
+		return;
+	}
+
+	size_t chunk = (count + workers - 1) / workers;
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	for (size_t worker = 1; worker < workers; ++worker)
+	{
+		size_t chunk_begin = begin + worker * chunk;
+		size_t chunk_end = std::min(end, chunk_begin + chunk);
+		if (chunk_begin >= chunk_end)
+		{
+			break;
+		}
+		threads.emplace_back(func, chunk_begin, chunk_end, worker);
+	}
+	// the calling thread takes the first chunk itself
+	func(begin, std::min(end, begin + chunk), size_t(0));
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
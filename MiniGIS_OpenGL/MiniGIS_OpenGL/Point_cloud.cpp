@@ -0,0 +1,65 @@
+#include "Point_cloud.h"
+#include "Las_reader.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+
+
+vector<glm::dvec3> read_points(const string& path, const vector<uint8_t>& classes)
+{
+	string extension = path.substr(min(path.size(), path.find_last_of('.')));
+	transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(tolower(c)); });
+	if (extension == ".las")
+	{
+		return read_las(path, classes).positions;
+	}
+
+	vector<glm::dvec3> points;
+	ifstream in(path);
+	if (!in)
+	{
+		cout << "Failed to open point file: " << path << endl;
+		return points;
+	}
+
+	glm::dvec3 point;
+	while (in >> point.x >> point.y >> point.z)
+	{
+		points.push_back(point);
+	}
+	return points;
+}
+
+void compute_bounds(const vector<glm::dvec3>& points, glm::dvec3& min, glm::dvec3& max)
+{
+	const double infinity = numeric_limits<double>::infinity();
+	vector<glm::dvec3> partial_min(get_worker_count(), glm::dvec3(infinity));
+	vector<glm::dvec3> partial_max(get_worker_count(), glm::dvec3(-infinity));
+
+	parallel_for(0, points.size(), [&](size_t begin, size_t end, size_t worker)
+	{
+		glm::dvec3 local_min(infinity);
+		glm::dvec3 local_max(-infinity);
+		for (size_t i = begin; i < end; ++i)
+		{
+			local_min = glm::min(local_min, points[i]);
+			local_max = glm::max(local_max, points[i]);
+		}
+		partial_min[worker] = local_min;
+		partial_max[worker] = local_max;
+	});
+
+	min = glm::dvec3(infinity);
+	max = glm::dvec3(-infinity);
+	for (size_t i = 0; i < partial_min.size(); ++i)
+	{
+		min = glm::min(min, partial_min[i]);
+		max = glm::max(max, partial_max[i]);
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reads a point file: LAS files (.las) through the binary LAS reader, any other file as whitespace separated "x y z"
+// coordinates. A non-empty classes list keeps only the LAS points of these classifications.
+// Coordinates stay in double precision, because survey data is usually georeferenced and does not fit into a float.
+std::vector<glm::dvec3> read_points(const std::string& path, const std::vector<uint8_t>& classes = std::vector<uint8_t>());
+
+// Computes the axis aligned bounding box of the points on all cores
+void compute_bounds(const std::vector<glm::dvec3>& points, glm::dvec3& min, glm::dvec3& max);
@@ -0,0 +1,412 @@
+#include "Point_octree.h"
+#include "Frustum.h"
+#include "Parallel.h"
+#include "Point_cloud.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <queue>
+
+using namespace std;
+
+
+namespace
+{
+	// bits per axis of a Morton code, and so the deepest level of the octree
+	const int MAX_DEPTH = 21;
+
+	enum class Coverage
+	{
+		OUTSIDE,
+		PARTIAL,
+		INSIDE
+	};
+
+	struct Morton_key
+	{
+		uint64_t code;
+		uint32_t index;
+	};
+
+	// Moves the lowest 21 bits of value two bits apart
+	uint64_t spread_bits(uint64_t value)
+	{
+		value &= 0x1fffff;
+		value = (value | value << 32) & 0x1f00000000ffff;
+		value = (value | value << 16) & 0x1f0000ff0000ff;
+		value = (value | value << 8) & 0x100f00f00f00f00f;
+		value = (value | value << 4) & 0x10c30c30c30c30c3;
+		value = (value | value << 2) & 0x1249249249249249;
+		return value;
+	}
+
+	// Sorts the keys by code: every worker sorts one run, then pairs of runs are merged in parallel
+	void sort_keys(vector<Morton_key>& keys)
+	{
+		auto by_code = [](const Morton_key& a, const Morton_key& b) { return a.code < b.code; };
+		vector<size_t> run_ends(get_worker_count(), 0);
+		parallel_for(0, keys.size(), [&](size_t begin, size_t end, size_t worker)
+		{
+			sort(keys.begin() + begin, keys.begin() + end, by_code);
+			run_ends[worker] = end;
+		}, 1 << 16);
+
+		// workers that got no chunk leave an empty run behind
+		vector<size_t> bounds(1, 0);
+		for (size_t end : run_ends)
+		{
+			if (end > bounds.back())
+			{
+				bounds.push_back(end);
+			}
+		}
+
+		vector<Morton_key> merged(keys.size());
+		while (bounds.size() > 2)
+		{
+			size_t pairs = (bounds.size() - 1) / 2;
+			parallel_for(0, pairs, [&](size_t begin, size_t end, size_t)
+			{
+				for (size_t pair = begin; pair < end; ++pair)
+				{
+					size_t first = bounds[pair * 2], middle = bounds[pair * 2 + 1], last = bounds[pair * 2 + 2];
+					merge(keys.begin() + first, keys.begin() + middle, keys.begin() + middle, keys.begin() + last,
+						merged.begin() + first, by_code);
+				}
+			}, 1);
+			// an odd run out is carried over as it is
+			if ((bounds.size() - 1) % 2 == 1)
+			{
+				copy(keys.begin() + bounds[bounds.size() - 2], keys.end(), merged.begin() + bounds[bounds.size() - 2]);
+			}
+			keys.swap(merged);
+
+			vector<size_t> merged_bounds;
+			for (size_t i = 0; i < bounds.size(); i += 2)
+			{
+				merged_bounds.push_back(bounds[i]);
+			}
+			if (merged_bounds.back() != bounds.back())
+			{
+				merged_bounds.push_back(bounds.back());
+			}
+			bounds.swap(merged_bounds);
+		}
+	}
+}
+
+// Builds the octree in parallel. Nodes with more than leaf_size points are split, inner nodes keep sample_size points.
+Point_octree::Point_octree(const vector<glm::dvec3>& points, size_t leaf_size, size_t sample_size) :
+	origin(0.0), point_count(0)
+{
+	// node ranges and the subsamples after the points are addressed with 32 bits
+	if (points.empty() || points.size() > numeric_limits<uint32_t>::max() / 2)
+	{
+		if (!points.empty())
+		{
+			cout << "Too many points for the octree: " << points.size() << endl;
+		}
+		return;
+	}
+	point_count = points.size();
+	leaf_size = max<size_t>(leaf_size, 1);
+	sample_size = max<size_t>(sample_size, 1);
+
+	// the root is a cube over the bounding box, the points are quantized to MAX_DEPTH bits inside of it
+	glm::dvec3 bounds_max;
+	compute_bounds(points, origin, bounds_max);
+	glm::dvec3 extent = bounds_max - origin;
+	double size = max(max(extent.x, extent.y), max(extent.z, 1e-9));
+	double cells = double(1 << MAX_DEPTH);
+	vector<Morton_key> keys(point_count);
+	parallel_for(0, point_count, [&](size_t begin, size_t end, size_t)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			glm::dvec3 cell = (points[i] - origin) / size * cells;
+			uint64_t x = uint64_t(min(max(cell.x, 0.0), cells - 1.0));
+			uint64_t y = uint64_t(min(max(cell.y, 0.0), cells - 1.0));
+			uint64_t z = uint64_t(min(max(cell.z, 0.0), cells - 1.0));
+			keys[i] = Morton_key{ spread_bits(x) | spread_bits(y) << 1 | spread_bits(z) << 2, uint32_t(i) };
+		}
+	});
+	sort_keys(keys);
+
+	// nodes are split breadth first, so the children of a node are appended next to each other
+	nodes.push_back(Node{ glm::vec3(0.0f), float(size), 0, uint32_t(point_count), 0, 0, 0, 0 });
+	vector<uint8_t> depths(1, 0);
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		Node node = nodes[i];
+		int depth = depths[i];
+		if (node.end - node.begin <= leaf_size || depth == MAX_DEPTH)
+		{
+			continue;
+		}
+
+		int shift = 3 * (MAX_DEPTH - 1 - depth);
+		float child_size = node.size * 0.5f;
+		uint32_t child_begin = node.begin;
+		nodes[i].first_child = uint32_t(nodes.size());
+		for (uint64_t child = 0; child < 8; ++child)
+		{
+			uint32_t child_end = uint32_t(partition_point(keys.begin() + child_begin, keys.begin() + node.end,
+				[shift, child](const Morton_key& key) { return ((key.code >> shift) & 7) <= child; }) - keys.begin());
+			if (child_end > child_begin)
+			{
+				glm::vec3 offset(float(child & 1), float((child >> 1) & 1), float((child >> 2) & 1));
+				nodes.push_back(Node{ node.min + offset * child_size, child_size, child_begin, child_end, 0, 0, 0, 0 });
+				depths.push_back(uint8_t(depth + 1));
+			}
+			child_begin = child_end;
+		}
+		nodes[i].child_count = uint32_t(nodes.size()) - nodes[i].first_child;
+	}
+
+	// a leaf draws its own points, the subsamples of inner nodes follow the points
+	size_t sample_end = point_count;
+	vector<uint32_t> inner_nodes;
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		Node& node = nodes[i];
+		if (node.child_count == 0)
+		{
+			node.draw_begin = node.begin;
+			node.draw_count = node.end - node.begin;
+		}
+		else
+		{
+			node.draw_begin = uint32_t(sample_end);
+			node.draw_count = uint32_t(min<size_t>(sample_size, node.end - node.begin));
+			sample_end += node.draw_count;
+			inner_nodes.push_back(uint32_t(i));
+		}
+	}
+
+	positions.resize(sample_end);
+	parallel_for(0, point_count, [&](size_t begin, size_t end, size_t)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			positions[i] = glm::vec3(points[keys[i].index] - origin);
+		}
+	});
+	vector<Morton_key>().swap(keys);
+
+	// every subsample takes evenly spaced points along the Morton curve, which spreads them over the whole node
+	parallel_for(0, inner_nodes.size(), [&](size_t begin, size_t end, size_t)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const Node& node = nodes[inner_nodes[i]];
+			uint64_t count = node.end - node.begin;
+			for (uint64_t sample = 0; sample < node.draw_count; ++sample)
+			{
+				positions[node.draw_begin + sample] = positions[node.begin + sample * count / node.draw_count];
+			}
+		}
+	}, 16);
+}
+
+// Appends the points inside the box [min, max] to result and returns their number
+size_t Point_octree::query_box(const glm::dvec3& min, const glm::dvec3& max, vector<glm::dvec3>& result) const
+{
+	auto inside_box = [&min, &max](const glm::dvec3& node_min, const glm::dvec3& node_max)
+	{
+		if (node_max.x < min.x || node_max.y < min.y || node_max.z < min.z ||
+			node_min.x > max.x || node_min.y > max.y || node_min.z > max.z)
+		{
+			return Coverage::OUTSIDE;
+		}
+		if (node_min.x >= min.x && node_min.y >= min.y && node_min.z >= min.z &&
+			node_max.x <= max.x && node_max.y <= max.y && node_max.z <= max.z)
+		{
+			return Coverage::INSIDE;
+		}
+		return Coverage::PARTIAL;
+	};
+	auto inside_point = [&min, &max](const glm::dvec3& point)
+	{
+		return point.x >= min.x && point.y >= min.y && point.z >= min.z &&
+			point.x <= max.x && point.y <= max.y && point.z <= max.z;
+	};
+	return _query(inside_box, inside_point, result);
+}
+
+// Appends the points within radius of center to result and returns their number
+size_t Point_octree::query_radius(const glm::dvec3& center, double radius, vector<glm::dvec3>& result) const
+{
+	double radius_squared = radius * radius;
+	auto inside_box = [&center, radius_squared](const glm::dvec3& node_min, const glm::dvec3& node_max)
+	{
+		// distances to the closest and the farthest point of the node
+		glm::dvec3 nearest = glm::clamp(center, node_min, node_max) - center;
+		glm::dvec3 farthest = glm::max(center - node_min, node_max - center);
+		if (glm::dot(nearest, nearest) > radius_squared)
+		{
+			return Coverage::OUTSIDE;
+		}
+		return glm::dot(farthest, farthest) <= radius_squared ? Coverage::INSIDE : Coverage::PARTIAL;
+	};
+	auto inside_point = [&center, radius_squared](const glm::dvec3& point)
+	{
+		glm::dvec3 offset = point - center;
+		return glm::dot(offset, offset) <= radius_squared;
+	};
+	return _query(inside_box, inside_point, result);
+}
+
+// Chooses the nodes to draw. Nodes outside of the frustum are skipped, the others are refined, coarsest looking first,
+// while the spacing of their drawn points projects to more than max_spacing_pixels and the refinement keeps the total
+// under point_budget points.
+void Point_octree::select_nodes(const glm::mat4& model_view, const glm::mat4& projection, float projection_scale,
+	float max_spacing_pixels, size_t point_budget, vector<uint32_t>& selected) const
+{
+	selected.clear();
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	glm::mat4 clip = projection * model_view;
+	auto is_visible = [&clip](const Node& node)
+	{
+		return !is_box_outside_frustum(clip, node.min, node.min + glm::vec3(node.size));
+	};
+
+	// model_view may scale, sizes are measured with its largest scale
+	float scale = max(glm::length(glm::vec3(model_view[0])),
+		max(glm::length(glm::vec3(model_view[1])), glm::length(glm::vec3(model_view[2]))));
+	auto get_spacing_pixels = [&](const Node& node)
+	{
+		// the points of a terrain lie on a surface, so n points are about size / sqrt(n) apart
+		glm::vec3 center = glm::vec3(model_view * glm::vec4(node.min + glm::vec3(node.size * 0.5f), 1.0f));
+		float radius = node.size * scale * 0.8660254f;
+		float distance = max(glm::length(center) - radius, 1e-6f);
+		float spacing = node.size * scale / sqrt(float(node.draw_count));
+		return spacing / distance * projection_scale;
+	};
+
+	priority_queue<pair<float, uint32_t>> queue;
+	if (!is_visible(nodes[0]))
+	{
+		return;
+	}
+	queue.push(make_pair(get_spacing_pixels(nodes[0]), 0u));
+	size_t planned = nodes[0].draw_count;
+	uint32_t visible_children[8];
+	while (!queue.empty())
+	{
+		float spacing_pixels = queue.top().first;
+		uint32_t index = queue.top().second;
+		queue.pop();
+		const Node& node = nodes[index];
+		if (node.child_count == 0 || spacing_pixels <= max_spacing_pixels)
+		{
+			selected.push_back(index);
+			continue;
+		}
+
+		// refining replaces the subsample of the node by the visible children
+		size_t refined = planned - node.draw_count;
+		uint32_t visible_count = 0;
+		for (uint32_t child = node.first_child; child < node.first_child + node.child_count; ++child)
+		{
+			if (is_visible(nodes[child]))
+			{
+				visible_children[visible_count++] = child;
+				refined += nodes[child].draw_count;
+			}
+		}
+		if (refined > point_budget)
+		{
+			selected.push_back(index);
+			continue;
+		}
+		planned = refined;
+		for (uint32_t i = 0; i < visible_count; ++i)
+		{
+			queue.push(make_pair(get_spacing_pixels(nodes[visible_children[i]]), visible_children[i]));
+		}
+	}
+}
+
+const vector<Point_octree::Node>& Point_octree::get_nodes() const
+{
+	return nodes;
+}
+
+const vector<glm::vec3>& Point_octree::get_positions() const
+{
+	return positions;
+}
+
+glm::dvec3 Point_octree::get_origin() const
+{
+	return origin;
+}
+
+size_t Point_octree::get_point_count() const
+{
+	return point_count;
+}
+
+size_t Point_octree::get_memory_bytes() const
+{
+	return nodes.capacity() * sizeof(Node) + positions.capacity() * sizeof(glm::vec3);
+}
+
+template <typename Inside_box, typename Inside_point>
+size_t Point_octree::_query(Inside_box inside_box, Inside_point inside_point, vector<glm::dvec3>& result) const
+{
+	if (nodes.empty())
+	{
+		return 0;
+	}
+
+	// depth first, at most 7 siblings wait on every level
+	uint32_t stack[7 * MAX_DEPTH + 1];
+	size_t stack_size = 0;
+	stack[stack_size++] = 0;
+	size_t found = 0;
+	while (stack_size > 0)
+	{
+		const Node& node = nodes[stack[--stack_size]];
+		glm::dvec3 node_min = origin + glm::dvec3(node.min);
+		Coverage coverage = inside_box(node_min, node_min + glm::dvec3(double(node.size)));
+		if (coverage == Coverage::OUTSIDE)
+		{
+			continue;
+		}
+		if (coverage == Coverage::INSIDE)
+		{
+			for (uint32_t i = node.begin; i < node.end; ++i)
+			{
+				result.push_back(origin + glm::dvec3(positions[i]));
+			}
+			found += node.end - node.begin;
+		}
+		else if (node.child_count == 0)
+		{
+			for (uint32_t i = node.begin; i < node.end; ++i)
+			{
+				glm::dvec3 point = origin + glm::dvec3(positions[i]);
+				if (inside_point(point))
+				{
+					result.push_back(point);
+					++found;
+				}
+			}
+		}
+		else
+		{
+			for (uint32_t child = node.first_child; child < node.first_child + node.child_count; ++child)
+			{
+				stack[stack_size++] = child;
+			}
+		}
+	}
+	return found;
+}
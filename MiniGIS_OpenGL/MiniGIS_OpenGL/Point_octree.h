@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Octree over raw points. The points are sorted along a Morton curve, so every node owns a contiguous range of them
+// and nodes are stored breadth first with their children next to each other.
+// Every inner node also holds a representative subsample of its points for level of detail drawing, a leaf draws
+// all of its points. Positions are kept in float relative to get_origin(); points, then subsamples, share one array,
+// so the points a node draws are always get_positions()[draw_begin, draw_begin + draw_count).
+class Point_octree
+{
+public:
+	struct Node
+	{
+		// cube of the node, relative to the origin
+		glm::vec3 min;
+		float size;
+		// range of the node in the Morton ordered points
+		uint32_t begin;
+		uint32_t end;
+		// the subsample of an inner node, the points themselves for a leaf
+		uint32_t draw_begin;
+		uint32_t draw_count;
+		// children are nodes[first_child, first_child + child_count), none for a leaf
+		uint32_t first_child;
+		uint32_t child_count;
+	};
+
+	// Builds the octree in parallel. Nodes with more than leaf_size points are split, inner nodes keep sample_size points.
+	Point_octree(const std::vector<glm::dvec3>& points, size_t leaf_size = 4096, size_t sample_size = 4096);
+
+	// Appends the points inside the box [min, max] to result and returns their number
+	size_t query_box(const glm::dvec3& min, const glm::dvec3& max, std::vector<glm::dvec3>& result) const;
+
+	// Appends the points within radius of center to result and returns their number
+	size_t query_radius(const glm::dvec3& center, double radius, std::vector<glm::dvec3>& result) const;
+
+	// Chooses the nodes to draw. model_view maps positions relative to the origin to view space. Nodes outside of the
+	// frustum are skipped, the others are refined, coarsest looking first, while the spacing of their drawn points
+	// projects to more than max_spacing_pixels and the refinement keeps the total under point_budget points.
+	// projection_scale is the screen height in pixels divided by 2 tan(fov / 2).
+	void select_nodes(const glm::mat4& model_view, const glm::mat4& projection, float projection_scale,
+		float max_spacing_pixels, size_t point_budget, std::vector<uint32_t>& selected) const;
+
+	const std::vector<Node>& get_nodes() const;
+	const std::vector<glm::vec3>& get_positions() const;
+	glm::dvec3 get_origin() const;
+	size_t get_point_count() const;
+	size_t get_memory_bytes() const;
+
+private:
+	glm::dvec3 origin;
+	size_t point_count;
+	std::vector<Node> nodes;
+	std::vector<glm::vec3> positions;
+
+	template <typename Inside_box, typename Inside_point>
+	size_t _query(Inside_box inside_box, Inside_point inside_point, std::vector<glm::dvec3>& result) const;
+};
@@ -0,0 +1,118 @@
+#include "Point_renderer.h"
+
+#include <iostream>
+
+using namespace std;
+
+
+namespace
+{
+	// nodes are refined until their points are at most this many pixels apart on screen
+	const float MAX_SPACING_PIXELS = 2.0f;
+	// upper bound of the points drawn per frame
+	const size_t POINT_BUDGET = 5000000;
+	const float POINT_SIZE = 2.0f;
+}
+
+// Starts streaming the positions of the octree. mesh_min and mesh_max are the world extent of the normalized mesh
+// the points are drawn with. The octree has to outlive the renderer. Must be called on the GL thread.
+Point_renderer::Point_renderer(const Point_octree& octree, const glm::dvec3& mesh_min, const glm::dvec3& mesh_max) :
+	octree(octree), shader("points_vs.glsl", "points_fs.glsl"), point_to_mesh(1.0f), drawn_points(0)
+{
+	// the same normalization to [-1, 1] as the mesh, starting from the origin of the octree
+	glm::dvec3 scale = 2.0 / glm::max(mesh_max - mesh_min, glm::dvec3(1e-12));
+	glm::dvec3 offset = (octree.get_origin() - mesh_min) * scale - 1.0;
+	point_to_mesh[0][0] = float(scale.x);
+	point_to_mesh[1][1] = float(scale.y);
+	point_to_mesh[2][2] = float(scale.z);
+	point_to_mesh[3] = glm::vec4(glm::vec3(offset), 1.0f);
+
+	shader.use();
+	shader.set_vec3("pointScale", glm::vec3(scale));
+	shader.set_vec3("pointOffset", glm::vec3(offset));
+	shader.set_vec3("lowColor", 0.2f, 0.3f, 0.6f);
+	shader.set_vec3("highColor", 1.0f, 0.5f, 0.31f);
+
+	// the octree keeps the points before the subsamples, the stream gets the subsamples first so the coarse nodes
+	// can be drawn after the first frames. The copy is released once it is written into the staging segments.
+	const vector<glm::vec3>& positions = octree.get_positions();
+	size_t point_count = octree.get_point_count();
+	shared_ptr<vector<float>> data = make_shared<vector<float>>();
+	data->reserve(positions.size() * 3);
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		const glm::vec3& position = positions[(point_count + i) % positions.size()];
+		data->push_back(position.x);
+		data->push_back(position.y);
+		data->push_back(position.z);
+	}
+	sample_count = uint32_t(positions.size() - point_count);
+	upload.reset(new Upload_stream(move(data)));
+
+	glGenVertexArrays(1, &VAO);
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, upload->get_buffer());
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+}
+
+Point_renderer::~Point_renderer()
+{
+	glDeleteVertexArrays(1, &VAO);
+	upload.reset();
+}
+
+// Continues the upload, chooses the nodes for the view and draws the ones that are uploaded
+void Point_renderer::draw(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, float projection_scale)
+{
+	upload->pump();
+	octree.select_nodes(view * model * point_to_mesh, projection, projection_scale, MAX_SPACING_PIXELS, POINT_BUDGET, selected);
+
+	// while uploading, a node whose points are not in the device buffer yet is left out
+	const vector<Point_octree::Node>& nodes = octree.get_nodes();
+	size_t point_count = octree.get_point_count();
+	size_t uploaded_points = upload->get_uploaded_bytes() / sizeof(glm::vec3);
+	firsts.clear();
+	counts.clear();
+	drawn_points = 0;
+	for (uint32_t index : selected)
+	{
+		size_t draw_begin = nodes[index].draw_begin;
+		size_t first = draw_begin < point_count ? draw_begin + sample_count : draw_begin - point_count;
+		if (first + nodes[index].draw_count > uploaded_points)
+		{
+			continue;
+		}
+		firsts.push_back(GLint(first));
+		counts.push_back(GLsizei(nodes[index].draw_count));
+		drawn_points += nodes[index].draw_count;
+	}
+
+	shader.use();
+	shader.set_mat4("model", model);
+	shader.set_mat4("view", view);
+	shader.set_mat4("projection", projection);
+	glPointSize(POINT_SIZE);
+	glBindVertexArray(VAO);
+	glMultiDrawArrays(GL_POINTS, firsts.data(), counts.data(), GLsizei(firsts.size()));
+	glBindVertexArray(0);
+}
+
+// Returns whether positions are still being uploaded, the view has to keep drawing until they are
+bool Point_renderer::is_uploading() const
+{
+	return !upload->is_finished();
+}
+
+// Returns the number of points the last draw call drew
+size_t Point_renderer::get_drawn_points() const
+{
+	return drawn_points;
+}
+
+void Point_renderer::print_statistics() const
+{
+	cout << "points ";
+	upload->print_statistics();
+}
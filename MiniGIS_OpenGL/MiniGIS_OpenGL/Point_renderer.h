@@ -0,0 +1,54 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "Point_octree.h"
+#include "Shader.h"
+#include "Upload_stream.h"
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+// Draws the raw points of an octree at a level of detail that follows the camera. Every frame the octree chooses
+// the nodes whose points are dense enough on screen, all of them are drawn with one glMultiDrawArrays call.
+// The positions are streamed into the device buffer over the first frames, the subsamples of the inner nodes first,
+// so a coarse view appears at once and nodes are drawn as soon as their points are uploaded.
+class Point_renderer
+{
+public:
+	// Starts streaming the positions of the octree. mesh_min and mesh_max are the world extent of the normalized mesh
+	// the points are drawn with. The octree has to outlive the renderer. Must be called on the GL thread.
+	Point_renderer(const Point_octree& octree, const glm::dvec3& mesh_min, const glm::dvec3& mesh_max);
+	~Point_renderer();
+
+	Point_renderer(const Point_renderer&) = delete;
+	Point_renderer& operator=(const Point_renderer&) = delete;
+
+	// Continues the upload, chooses the nodes for the view and draws the ones that are uploaded.
+	// projection_scale is the screen height in pixels divided by 2 tan(fov / 2).
+	void draw(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, float projection_scale);
+
+	// Returns whether positions are still being uploaded, the view has to keep drawing until they are
+	bool is_uploading() const;
+
+	// Returns the number of points the last draw call drew
+	size_t get_drawn_points() const;
+
+	void print_statistics() const;
+
+private:
+	const Point_octree& octree;
+	Shader shader;
+	// the subsamples come first in the device buffer, so the points of a node are moved by the number of subsampled
+	// positions and the subsamples by minus the number of points
+	std::unique_ptr<Upload_stream> upload;
+	uint32_t sample_count;
+	unsigned int VAO;
+	// octree positions to normalized mesh coordinates
+	glm::mat4 point_to_mesh;
+	std::vector<uint32_t> selected;
+	std::vector<GLint> firsts;
+	std::vector<GLsizei> counts;
+	size_t drawn_points;
+};
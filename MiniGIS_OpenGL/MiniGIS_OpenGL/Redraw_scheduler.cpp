@@ -0,0 +1,117 @@
+#include "Redraw_scheduler.h"
+
+#include <iostream>
+#include <windows.h>
+
+using namespace std;
+
+
+// idle_timeout is the longest time in seconds the loop sleeps without an event
+Redraw_scheduler::Redraw_scheduler(double idle_timeout) :
+	idle_timeout(idle_timeout), redraw_requested(true), animating(false),
+	frames(0), idle_waits(0), start_time(0.0), start_cpu_time(0.0), idle_time(0.0), idle_cpu_time(0.0),
+	idle_start_time(-1.0), idle_start_cpu_time(0.0)
+{
+}
+
+// Marks the current image as out of date, e.g. after the camera, the window or the scene changed
+void Redraw_scheduler::request_redraw()
+{
+	redraw_requested = true;
+}
+
+// Keeps drawing every frame while animating is true
+void Redraw_scheduler::set_animating(bool animating)
+{
+	this->animating = animating;
+}
+
+bool Redraw_scheduler::is_animating() const
+{
+	return animating;
+}
+
+// Processes pending window events. Blocks until the next event or the idle timeout while nothing is to be drawn.
+void Redraw_scheduler::wait_events()
+{
+	// the previous iteration waited and drew nothing, it counts as idle up to here
+	double time = glfwGetTime();
+	double cpu_time = _get_process_cpu_time();
+	if (idle_start_time >= 0.0)
+	{
+		idle_time += time - idle_start_time;
+		idle_cpu_time += cpu_time - idle_start_cpu_time;
+		idle_start_time = -1.0;
+	}
+
+	if (should_draw())
+	{
+		glfwPollEvents();
+	}
+	else
+	{
+		idle_start_time = time;
+		idle_start_cpu_time = cpu_time;
+		glfwWaitEventsTimeout(idle_timeout);
+		idle_waits++;
+	}
+}
+
+// Returns whether the next frame has to be drawn
+bool Redraw_scheduler::should_draw() const
+{
+	return redraw_requested || animating;
+}
+
+// Called after a frame has been drawn and swapped
+void Redraw_scheduler::frame_drawn()
+{
+	redraw_requested = false;
+	frames++;
+	// the wait before this frame ended in a draw, it is not idle
+	idle_start_time = -1.0;
+}
+
+// Starts a new measurement for print_statistics
+void Redraw_scheduler::reset_statistics()
+{
+	frames = 0;
+	idle_waits = 0;
+	start_time = glfwGetTime();
+	start_cpu_time = _get_process_cpu_time();
+	idle_time = 0.0;
+	idle_cpu_time = 0.0;
+	idle_start_time = -1.0;
+}
+
+// Prints the drawn frames, the idle waits and the CPU time of the process since reset_statistics, in total and
+// over the idle iterations of the loop
+void Redraw_scheduler::print_statistics() const
+{
+	double elapsed = glfwGetTime() - start_time;
+	double cpu_time = _get_process_cpu_time() - start_cpu_time;
+	if (elapsed <= 0.0)
+	{
+		return;
+	}
+	cout << "viewer: " << frames << " frames drawn in " << elapsed << " s (" << frames / elapsed << " fps), "
+		<< idle_waits << " idle waits, CPU time " << cpu_time << " s (" << 100.0 * cpu_time / elapsed << "% of one core)" << endl;
+	cout << "viewer: idle for " << idle_time << " s, CPU time while idle " << idle_cpu_time << " s ("
+		<< (idle_time > 0.0 ? 100.0 * idle_cpu_time / idle_time : 0.0) << "% of one core)" << endl;
+}
+
+double Redraw_scheduler::_get_process_cpu_time()
+{
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+	{
+		return 0.0;
+	}
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernel_time.dwLowDateTime;
+	kernel.HighPart = kernel_time.dwHighDateTime;
+	user.LowPart = user_time.dwLowDateTime;
+	user.HighPart = user_time.dwHighDateTime;
+	// FILETIME counts 100 ns intervals
+	return (kernel.QuadPart + user.QuadPart) * 1e-7;
+}
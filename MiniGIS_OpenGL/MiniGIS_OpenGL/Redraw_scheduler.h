@@ -0,0 +1,55 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+
+#include <cstddef>
+
+// Decides when the viewer draws a frame. While nothing changes the render thread sleeps in glfwWaitEventsTimeout
+// instead of redrawing the same image; while something is animated (e.g. a key is held) every frame is drawn.
+class Redraw_scheduler
+{
+public:
+	// idle_timeout is the longest time in seconds the loop sleeps without an event
+	explicit Redraw_scheduler(double idle_timeout = 0.5);
+
+	// Marks the current image as out of date, e.g. after the camera, the window or the scene changed
+	void request_redraw();
+
+	// Keeps drawing every frame while animating is true
+	void set_animating(bool animating);
+	bool is_animating() const;
+
+	// Processes pending window events. Blocks until the next event or the idle timeout while nothing is to be drawn.
+	void wait_events();
+
+	// Returns whether the next frame has to be drawn
+	bool should_draw() const;
+
+	// Called after a frame has been drawn and swapped
+	void frame_drawn();
+
+	// Starts a new measurement for print_statistics
+	void reset_statistics();
+
+	// Prints the drawn frames, the idle waits and the CPU time of the process since reset_statistics, in total and
+	// over the idle iterations of the loop, those that waited for events and drew nothing
+	void print_statistics() const;
+
+private:
+	double idle_timeout;
+	bool redraw_requested;
+	bool animating;
+	// statistics
+	size_t frames;
+	size_t idle_waits;
+	double start_time;
+	double start_cpu_time;
+	double idle_time;
+	double idle_cpu_time;
+	// start of the current idle wait, negative while not waiting
+	double idle_start_time;
+	double idle_start_cpu_time;
+
+	static double _get_process_cpu_time();
+};
@@ -0,0 +1,204 @@
+#include "Relief_baker.h"
+#include "Hash.h"
+#include "Mesh_index.h"
+#include "Parallel.h"
+#include "Triangle_bvh.h"
+
+#include <chrono>
+#include <cstdint>
+#include <direct.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+
+namespace
+{
+	const size_t INPUT_STRIDE = 6;
+	const size_t OUTPUT_STRIDE = 8;
+	// rays start this far above the surface so they do not hit the triangles around their own vertex
+	const float SURFACE_OFFSET = 1e-3f;
+	// longer than the diagonal of the normalized mesh
+	const float SUN_DISTANCE = 4.0f;
+	const float PI = 3.14159265358979f;
+
+	const char* CACHE_DIRECTORY = "relief_cache";
+	const uint32_t CACHE_MAGIC = 0x32464c52; // "RLF2"
+
+	struct Cache_header
+	{
+		uint32_t magic;
+		uint32_t reserved;
+		uint64_t key;
+		uint64_t vertex_count;
+		double bake_milliseconds;
+	};
+
+	uint64_t cache_key(const vector<float>& vertices, const Relief_settings& settings)
+	{
+		uint64_t key = hash_bytes(vertices.data(), vertices.size() * sizeof(float));
+		key = hash_bytes(&settings.occlusion_samples, sizeof(settings.occlusion_samples), key);
+		key = hash_bytes(&settings.occlusion_radius, sizeof(settings.occlusion_radius), key);
+		key = hash_bytes(&settings.sun_azimuth, sizeof(settings.sun_azimuth), key);
+		return hash_bytes(&settings.sun_altitude, sizeof(settings.sun_altitude), key);
+	}
+
+	string cache_path(uint64_t key)
+	{
+		ostringstream path;
+		path << CACHE_DIRECTORY << "/" << hex << setw(16) << setfill('0') << key << ".relief";
+		return path.str();
+	}
+
+	bool load_cache(const string& path, uint64_t key, size_t vertex_count, vector<float>& relief, double& bake_milliseconds)
+	{
+		ifstream in(path, ios::binary);
+		Cache_header header;
+		if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+			header.magic != CACHE_MAGIC || header.key != key || header.vertex_count != vertex_count)
+		{
+			return false;
+		}
+		relief.resize(vertex_count * 2);
+		if (!in.read(reinterpret_cast<char*>(relief.data()), relief.size() * sizeof(float)))
+		{
+			return false;
+		}
+		bake_milliseconds = header.bake_milliseconds;
+		return true;
+	}
+
+	void save_cache(const string& path, uint64_t key, const vector<float>& relief, double bake_milliseconds)
+	{
+		_mkdir(CACHE_DIRECTORY);
+		ofstream out(path, ios::binary);
+		Cache_header header = { CACHE_MAGIC, 0, key, relief.size() / 2, bake_milliseconds };
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(relief.data()), relief.size() * sizeof(float));
+		if (!out)
+		{
+			cout << "Failed to write relief cache: " << path << endl;
+		}
+	}
+
+	float radical_inverse(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return float(bits) * 2.3283064365386963e-10f;
+	}
+
+	// Returns ambient occlusion and hillshade for every soup vertex
+	vector<float> compute_relief(const vector<float>& vertices, const Relief_settings& settings)
+	{
+		Indexed_mesh mesh = index_vertices(vertices, INPUT_STRIDE);
+		// turning a triangle swaps two of its indices, the bake is scattered back through the order of the soup
+		vector<unsigned int> soup_vertices = mesh.indices;
+		orient_upwards(mesh);
+		vector<glm::vec3> normals = compute_vertex_normals(mesh);
+
+		Triangle_bvh bvh(mesh.positions, mesh.indices);
+
+		float azimuth = glm::radians(settings.sun_azimuth);
+		float altitude = glm::radians(settings.sun_altitude);
+		glm::vec3 sun(cos(altitude) * sin(azimuth), cos(altitude) * cos(azimuth), sin(altitude));
+
+		// cosine weighted hemisphere directions around +z
+		size_t sample_count = size_t(std::max(settings.occlusion_samples, 1));
+		vector<glm::vec3> samples(sample_count);
+		for (size_t i = 0; i < sample_count; ++i)
+		{
+			float u = (i + 0.5f) / sample_count;
+			float phi = 2.0f * PI * radical_inverse(uint32_t(i));
+			float r = sqrt(u);
+			samples[i] = glm::vec3(r * cos(phi), r * sin(phi), sqrt(1.0f - u));
+		}
+
+		vector<glm::vec2> baked(mesh.positions.size());
+		parallel_for(0, mesh.positions.size(), [&](size_t begin, size_t end, size_t)
+		{
+			for (size_t v = begin; v < end; ++v)
+			{
+				const glm::vec3& n = normals[v];
+				glm::vec3 origin = mesh.positions[v] + n * SURFACE_OFFSET;
+
+				// tangent frame, rotated by a different angle per vertex to turn banding into noise
+				glm::vec3 helper = abs(n.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+				glm::vec3 tangent = glm::normalize(glm::cross(helper, n));
+				glm::vec3 bitangent = glm::cross(n, tangent);
+				float rotation = 2.0f * PI * radical_inverse(uint32_t(v) * 2654435761u);
+				float rotation_cos = cos(rotation);
+				float rotation_sin = sin(rotation);
+
+				size_t hits = 0;
+				for (const glm::vec3& sample : samples)
+				{
+					float x = sample.x * rotation_cos - sample.y * rotation_sin;
+					float y = sample.x * rotation_sin + sample.y * rotation_cos;
+					glm::vec3 direction = glm::normalize(tangent * x + bitangent * y + n * sample.z);
+					if (bvh.is_occluded(origin, direction, settings.occlusion_radius))
+					{
+						hits++;
+					}
+				}
+
+				float lambert = std::max(glm::dot(n, sun), 0.0f);
+				bool lit = lambert > 0.0f && !bvh.is_occluded(origin, sun, SUN_DISTANCE);
+				baked[v] = glm::vec2(1.0f - float(hits) / sample_count, lit ? lambert : 0.0f);
+			}
+		}, 64);
+
+		vector<float> relief(soup_vertices.size() * 2);
+		for (size_t i = 0; i < soup_vertices.size(); ++i)
+		{
+			relief[2 * i] = baked[soup_vertices[i]].x;
+			relief[2 * i + 1] = baked[soup_vertices[i]].y;
+		}
+		return relief;
+	}
+}
+
+// Appends baked ambient occlusion and sun hillshade to every vertex of a position/normal triangle soup, so the result
+// has 8 floats per vertex. Both are ray cast against the mesh on all cores. The bake is cached in relief_cache/,
+// keyed by the mesh contents and the settings, so an unchanged mesh is only baked once.
+vector<float> bake_relief(const vector<float>& vertices, const Relief_settings& settings)
+{
+	size_t vertex_count = vertices.size() / INPUT_STRIDE;
+	uint64_t key = cache_key(vertices, settings);
+	string path = cache_path(key);
+
+	vector<float> relief;
+	double bake_milliseconds = 0.0;
+	if (load_cache(path, key, vertex_count, relief, bake_milliseconds))
+	{
+		cout << "relief loaded from " << path << " (baked in " << bake_milliseconds << " ms)" << endl;
+	}
+	else
+	{
+		auto start = chrono::steady_clock::now();
+		relief = compute_relief(vertices, settings);
+		bake_milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		cout << "relief baked in " << bake_milliseconds << " ms on " << get_worker_count() << " threads ("
+			<< vertex_count << " vertices, " << settings.occlusion_samples << " occlusion rays each)" << endl;
+		save_cache(path, key, relief, bake_milliseconds);
+	}
+
+	vector<float> result(vertex_count * OUTPUT_STRIDE);
+	parallel_for(0, vertex_count, [&](size_t begin, size_t end, size_t)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			copy(&vertices[i * INPUT_STRIDE], &vertices[i * INPUT_STRIDE] + INPUT_STRIDE, &result[i * OUTPUT_STRIDE]);
+			result[i * OUTPUT_STRIDE + 6] = relief[2 * i];
+			result[i * OUTPUT_STRIDE + 7] = relief[2 * i + 1];
+		}
+	});
+	return result;
+}
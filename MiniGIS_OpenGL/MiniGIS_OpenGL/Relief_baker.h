@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Parameters of the relief bake. The defaults give the classic north-west hillshade.
+struct Relief_settings
+{
+	// ambient occlusion rays per vertex
+	int occlusion_samples = 32;
+	// occluders further away than this (in normalized mesh units) do not darken a vertex
+	float occlusion_radius = 0.25f;
+	// sun direction in degrees: azimuth clockwise from +y, altitude above the xy plane
+	float sun_azimuth = 315.0f;
+	float sun_altitude = 45.0f;
+};
+
+// Appends baked ambient occlusion and sun hillshade to every vertex of a position/normal triangle soup, so the result
+// has 8 floats per vertex. Both are ray cast against the mesh on all cores. The bake is cached in relief_cache/,
+// keyed by the mesh contents and the settings, so an unchanged mesh is only baked once.
+std::vector<float> bake_relief(const std::vector<float>& vertices, const Relief_settings& settings = Relief_settings());
@@ -1,10 +1,53 @@
 #include "Shader.h"
+#include "Hash.h"
+
+#include <cstring>
+#include <direct.h>
+#include <iomanip>
 
 using namespace std;
 
 
-// constructor generates the shader on the fly
-Shader::Shader(const char* vertex_path, const char* fragment_path, const char* geometry_path) :
+namespace
+{
+	const char* CACHE_DIRECTORY = "shader_cache";
+	const uint32_t CACHE_MAGIC = 0x31485350; // "PSH1"
+
+	struct Cache_header
+	{
+		uint32_t magic;
+		uint32_t binary_format;
+		uint64_t key;
+		uint64_t size;
+	};
+
+	// inserts the defines right after the #version line, which has to stay the first statement
+	string add_defines(const string& code, const vector<string>& defines)
+	{
+		if (code.empty() || defines.empty())
+		{
+			return code;
+		}
+		string define_lines;
+		for (const string& define : defines)
+		{
+			define_lines += "#define " + define + "\n";
+		}
+		size_t version = code.find("#version");
+		size_t line_end = version == string::npos ? string::npos : code.find('\n', version);
+		if (line_end == string::npos)
+		{
+			return version == string::npos ? define_lines + code : code + "\n" + define_lines;
+		}
+		return code.substr(0, line_end + 1) + define_lines + code.substr(line_end + 1);
+	}
+}
+
+
+// constructor generates the shader on the fly. Every define is inserted as "#define <define>" after the #version line,
+// so one source can be specialized into several variants. Linked programs are cached in shader_cache/, keyed by
+// the specialized sources and the driver, and are compiled from source again when the cache is stale.
+Shader::Shader(const char* vertex_path, const char* fragment_path, const char* geometry_path, const vector<string>& defines) :
 	attributes(attributes)
 {
 	// 1. retrieve the vertex/fragment source code from filePath
@@ -47,6 +90,17 @@ Shader::Shader(const char* vertex_path, const char* fragment_path, const char* g
 	{
 		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 	}
+	vertex_code = add_defines(vertex_code, defines);
+	fragment_code = add_defines(fragment_code, defines);
+	geometry_code = add_defines(geometry_code, defines);
+
+	// reuse the linked program of an earlier run if the sources and the driver did not change
+	uint64_t cache_key = _get_cache_key(vertex_code, fragment_code, geometry_code);
+	if (_is_binary_cache_supported() && _load_binary(cache_key))
+	{
+		return;
+	}
+
 	const char* v_shader_code = vertex_code.c_str();
 	const char* f_shader_code = fragment_code.c_str();
 	// 2. compile shaders
@@ -73,6 +127,10 @@ Shader::Shader(const char* vertex_path, const char* fragment_path, const char* g
 	}
 	// shader program
 	program = glCreateProgram();
+	if (_is_binary_cache_supported())
+	{
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glAttachShader(program, vertex);
 	glAttachShader(program, fragment);
 	if (geometry_path != nullptr)
@@ -86,7 +144,7 @@ Shader::Shader(const char* vertex_path, const char* fragment_path, const char* g
 	}
 
 	glLinkProgram(program);
-	_check_compile_errors(program, "PROGRAM");
+	bool linked = _check_compile_errors(program, "PROGRAM");
 	// delete the shaders as they're linked into our program now and no longer necessery
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
@@ -94,6 +152,11 @@ Shader::Shader(const char* vertex_path, const char* fragment_path, const char* g
 	{
 		glDeleteShader(geometry);
 	}
+
+	if (linked && _is_binary_cache_supported())
+	{
+		_save_binary(cache_key);
+	}
 }
 
 // activate the shader
@@ -172,7 +235,7 @@ void Shader::set_mat4(const std::string& name, const glm::mat4& mat) const
 }
 
 
-void Shader::_check_compile_errors(GLuint shader, std::string type)
+bool Shader::_check_compile_errors(GLuint shader, std::string type)
 {
 	GLint success;
 	GLchar info_log[1024];
@@ -194,9 +257,99 @@ void Shader::_check_compile_errors(GLuint shader, std::string type)
 			std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << info_log << "\n -- --------------------------------------------------- -- " << std::endl;
 		}
 	}
+	return success != 0;
 }
 
 unsigned int Shader::get_program() const
 {
 	return program;
-}
\ No newline at end of file
+}
+
+bool Shader::_is_binary_cache_supported()
+{
+	GLint format_count = 0;
+	if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+	{
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+	}
+	return format_count > 0;
+}
+
+uint64_t Shader::_get_cache_key(const std::string& vertex_code, const std::string& fragment_code, const std::string& geometry_code)
+{
+	// binaries are only valid for the driver that produced them
+	const char* driver[] = {
+		reinterpret_cast<const char*>(glGetString(GL_VENDOR)),
+		reinterpret_cast<const char*>(glGetString(GL_RENDERER)),
+		reinterpret_cast<const char*>(glGetString(GL_VERSION))
+	};
+	uint64_t key = hash_bytes(vertex_code.c_str(), vertex_code.size() + 1);
+	key = hash_bytes(fragment_code.c_str(), fragment_code.size() + 1, key);
+	key = hash_bytes(geometry_code.c_str(), geometry_code.size() + 1, key);
+	for (const char* part : driver)
+	{
+		if (part != nullptr)
+		{
+			key = hash_bytes(part, strlen(part) + 1, key);
+		}
+	}
+	return key;
+}
+
+std::string Shader::_get_cache_path(uint64_t key)
+{
+	std::ostringstream path;
+	path << CACHE_DIRECTORY << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+	return path.str();
+}
+
+bool Shader::_load_binary(uint64_t key)
+{
+	std::ifstream in(_get_cache_path(key), std::ios::binary);
+	Cache_header header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != CACHE_MAGIC || header.key != key)
+	{
+		return false;
+	}
+	std::vector<char> binary(size_t(header.size));
+	if (!in.read(binary.data(), binary.size()))
+	{
+		return false;
+	}
+
+	program = glCreateProgram();
+	glProgramBinary(program, header.binary_format, binary.data(), GLsizei(binary.size()));
+	GLint success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		// the driver rejects binaries of other driver versions, fall back to the sources
+		glDeleteProgram(program);
+		program = 0;
+		return false;
+	}
+	return true;
+}
+
+void Shader::_save_binary(uint64_t key) const
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+	std::vector<char> binary(length);
+	GLenum binary_format = 0;
+	glGetProgramBinary(program, length, &length, &binary_format, binary.data());
+
+	_mkdir(CACHE_DIRECTORY);
+	std::ofstream out(_get_cache_path(key), std::ios::binary);
+	Cache_header header = { CACHE_MAGIC, binary_format, key, uint64_t(length) };
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(binary.data(), length);
+	if (!out)
+	{
+		std::cout << "ERROR::SHADER::BINARY_CACHE_NOT_WRITTEN" << std::endl;
+	}
+}
@@ -3,6 +3,7 @@
 #include "GLFW/glfw3.h"
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <fstream>
@@ -14,8 +15,11 @@ class Shader
 public:
 	unsigned int get_program() const;
 
-	// constructor generates the shader on the fly
-	Shader(const char* vertex_path, const char* fragment_path, const char* geometry_path = nullptr);
+	// constructor generates the shader on the fly. Every define is inserted as "#define <define>" after the #version line,
+	// so one source can be specialized into several variants. Linked programs are cached in shader_cache/, keyed by
+	// the specialized sources and the driver, and are compiled from source again when the cache is stale.
+	Shader(const char* vertex_path, const char* fragment_path, const char* geometry_path = nullptr,
+		const std::vector<std::string>& defines = std::vector<std::string>());
 	
 	// activate the shader
 	void use();
@@ -50,6 +54,13 @@ private:
 	unsigned int program;
 	// utility function for checking shader compilation/linking errors.
 	std::vector<const char*> attributes;
-	void _check_compile_errors(GLuint shader, std::string type);
+	bool _check_compile_errors(GLuint shader, std::string type);
+
+	// program binary cache
+	static bool _is_binary_cache_supported();
+	static uint64_t _get_cache_key(const std::string& vertex_code, const std::string& fragment_code, const std::string& geometry_code);
+	static std::string _get_cache_path(uint64_t key);
+	bool _load_binary(uint64_t key);
+	void _save_binary(uint64_t key) const;
 };
 
@@ -0,0 +1,284 @@
+#include "Survey_comparison.h"
+#include "Parallel.h"
+#include "Point_cloud.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+
+namespace
+{
+	// Mean distance between neighbouring points if they were spread evenly over their xy extent
+	double estimate_spacing(const glm::dvec3& min, const glm::dvec3& max, size_t point_count)
+	{
+		double area = (max.x - min.x) * (max.y - min.y);
+		if (point_count == 0 || area <= 0.0)
+		{
+			return 1.0;
+		}
+		return sqrt(area / point_count);
+	}
+
+	// Diverging blue - white - red color map for t in [-1, 1]
+	glm::vec3 difference_color(double t)
+	{
+		const glm::vec3 cut_color(0.23f, 0.30f, 0.75f);
+		const glm::vec3 zero_color(0.87f, 0.87f, 0.87f);
+		const glm::vec3 fill_color(0.71f, 0.02f, 0.15f);
+		t = std::max(-1.0, std::min(1.0, t));
+		if (t < 0.0)
+		{
+			return glm::mix(zero_color, cut_color, float(-t));
+		}
+		return glm::mix(zero_color, fill_color, float(t));
+	}
+}
+
+// Grids both surveys. A cell_size of zero derives the cell size from the point density of the sparser survey.
+Survey_comparison::Survey_comparison(const vector<glm::dvec3>& before, const vector<glm::dvec3>& after, double cell_size)
+{
+	glm::dvec3 before_min, before_max, after_min, after_max;
+	compute_bounds(before, before_min, before_max);
+	compute_bounds(after, after_min, after_max);
+
+	if (cell_size <= 0.0)
+	{
+		// about four points of the sparser survey per cell
+		cell_size = 2.0 * std::max(estimate_spacing(before_min, before_max, before.size()),
+			estimate_spacing(after_min, after_max, after.size()));
+	}
+
+	glm::dvec3 overlap_min = glm::max(before_min, after_min);
+	glm::dvec3 overlap_max = glm::min(before_max, after_max);
+	size_t cols = 0, rows = 0;
+	if (overlap_max.x > overlap_min.x && overlap_max.y > overlap_min.y)
+	{
+		cols = size_t(ceil((overlap_max.x - overlap_min.x) / cell_size));
+		rows = size_t(ceil((overlap_max.y - overlap_min.y) / cell_size));
+	}
+
+	this->before = Height_grid(overlap_min.x, overlap_min.y, cell_size, cols, rows);
+	this->after = Height_grid(overlap_min.x, overlap_min.y, cell_size, cols, rows);
+	this->before.set_points(before);
+	this->after.set_points(after);
+}
+
+// Accumulates cut and fill volumes, areas and difference statistics over the cells covered by both surveys
+Volume_statistics Survey_comparison::compute_statistics() const
+{
+	struct Partial
+	{
+		double cut = 0.0, fill = 0.0, sum = 0.0, sum_squares = 0.0;
+		size_t cut_cells = 0, fill_cells = 0, cells = 0;
+		double min = numeric_limits<double>::infinity();
+		double max = -numeric_limits<double>::infinity();
+	};
+	vector<Partial> partials(get_worker_count());
+
+	parallel_for(0, after.get_rows(), [&](size_t begin, size_t end, size_t worker)
+	{
+		Partial partial;
+		for (size_t row = begin; row < end; ++row)
+		{
+			for (size_t col = 0; col < after.get_cols(); ++col)
+			{
+				if (!_is_covered(col, row))
+				{
+					continue;
+				}
+				double difference = after.get_height(col, row) - before.get_height(col, row);
+				if (difference < 0.0)
+				{
+					partial.cut -= difference;
+					partial.cut_cells++;
+				}
+				else if (difference > 0.0)
+				{
+					partial.fill += difference;
+					partial.fill_cells++;
+				}
+				partial.sum += difference;
+				partial.sum_squares += difference * difference;
+				partial.min = std::min(partial.min, difference);
+				partial.max = std::max(partial.max, difference);
+				partial.cells++;
+			}
+		}
+		partials[worker] = partial;
+	}, 1);
+
+	Partial total;
+	for (const Partial& partial : partials)
+	{
+		total.cut += partial.cut;
+		total.fill += partial.fill;
+		total.sum += partial.sum;
+		total.sum_squares += partial.sum_squares;
+		total.cut_cells += partial.cut_cells;
+		total.fill_cells += partial.fill_cells;
+		total.cells += partial.cells;
+		total.min = std::min(total.min, partial.min);
+		total.max = std::max(total.max, partial.max);
+	}
+
+	Volume_statistics statistics;
+	if (total.cells == 0)
+	{
+		return statistics;
+	}
+	double cell_area = after.get_cell_size() * after.get_cell_size();
+	statistics.cut_volume = total.cut * cell_area;
+	statistics.fill_volume = total.fill * cell_area;
+	statistics.cut_area = total.cut_cells * cell_area;
+	statistics.fill_area = total.fill_cells * cell_area;
+	statistics.overlap_area = total.cells * cell_area;
+	statistics.min_difference = total.min;
+	statistics.max_difference = total.max;
+	statistics.mean_difference = total.sum / total.cells;
+	statistics.rms_difference = sqrt(total.sum_squares / total.cells);
+	statistics.cell_count = total.cells;
+	return statistics;
+}
+
+// Triangulates the after surface over the overlap. Every vertex holds position, normal and a color mapped
+// from the height difference (blue for cut, red for fill), positions are scaled to [-1, 1] like the reconstructed mesh.
+vector<float> Survey_comparison::build_difference_mesh() const
+{
+	const size_t stride = 9;
+	size_t cols = after.get_cols();
+	size_t rows = after.get_rows();
+	vector<float> vertices;
+	if (cols < 2 || rows < 2)
+	{
+		return vertices;
+	}
+
+	// 1. count the quads of every row whose four corners are covered, and find the height range for scaling
+	vector<size_t> row_offsets(rows, 0);
+	vector<double> partial_min(get_worker_count(), numeric_limits<double>::infinity());
+	vector<double> partial_max(get_worker_count(), -numeric_limits<double>::infinity());
+	vector<double> partial_difference(get_worker_count(), 0.0);
+	parallel_for(0, rows - 1, [&](size_t begin, size_t end, size_t worker)
+	{
+		for (size_t row = begin; row < end; ++row)
+		{
+			size_t quads = 0;
+			for (size_t col = 0; col < cols; ++col)
+			{
+				if (_is_covered(col, row))
+				{
+					double height = after.get_height(col, row);
+					partial_min[worker] = std::min(partial_min[worker], height);
+					partial_max[worker] = std::max(partial_max[worker], height);
+					partial_difference[worker] = std::max(partial_difference[worker], abs(height - before.get_height(col, row)));
+				}
+				if (col + 1 < cols && _is_covered(col, row) && _is_covered(col + 1, row) &&
+					_is_covered(col, row + 1) && _is_covered(col + 1, row + 1))
+				{
+					quads++;
+				}
+			}
+			row_offsets[row] = quads;
+		}
+	}, 1);
+
+	double min_z = *min_element(partial_min.begin(), partial_min.end());
+	double max_z = *max_element(partial_max.begin(), partial_max.end());
+	double max_difference = *max_element(partial_difference.begin(), partial_difference.end());
+	for (size_t col = 0; col < cols; ++col)
+	{
+		if (_is_covered(col, rows - 1))
+		{
+			double height = after.get_height(col, rows - 1);
+			min_z = std::min(min_z, height);
+			max_z = std::max(max_z, height);
+			max_difference = std::max(max_difference, abs(height - before.get_height(col, rows - 1)));
+		}
+	}
+
+	size_t quad_count = 0;
+	for (size_t row = 0; row < rows; ++row)
+	{
+		size_t quads = row_offsets[row];
+		row_offsets[row] = quad_count;
+		quad_count += quads;
+	}
+	vertices.resize(quad_count * 6 * stride);
+
+	// 2. every row writes its triangles at its own offset
+	glm::dvec2 min_xy = after.get_cell_center(0, 0);
+	glm::dvec2 max_xy = after.get_cell_center(cols - 1, rows - 1);
+	glm::dvec3 min(min_xy, min_z);
+	glm::dvec3 extent = glm::max(glm::dvec3(max_xy, max_z) - min, glm::dvec3(numeric_limits<double>::epsilon()));
+	max_difference = std::max(max_difference, numeric_limits<double>::epsilon());
+
+	parallel_for(0, rows - 1, [&](size_t begin, size_t end, size_t)
+	{
+		for (size_t row = begin; row < end; ++row)
+		{
+			float* out = vertices.data() + row_offsets[row] * 6 * stride;
+			for (size_t col = 0; col + 1 < cols; ++col)
+			{
+				if (!_is_covered(col, row) || !_is_covered(col + 1, row) ||
+					!_is_covered(col, row + 1) || !_is_covered(col + 1, row + 1))
+				{
+					continue;
+				}
+
+				const size_t corners[2][3][2] = {
+					{ { col, row }, { col + 1, row }, { col, row + 1 } },
+					{ { col + 1, row }, { col + 1, row + 1 }, { col, row + 1 } }
+				};
+				for (int triangle = 0; triangle < 2; ++triangle)
+				{
+					glm::dvec3 points[3];
+					double differences[3];
+					for (int i = 0; i < 3; ++i)
+					{
+						size_t c = corners[triangle][i][0];
+						size_t r = corners[triangle][i][1];
+						points[i] = glm::dvec3(after.get_cell_center(c, r), after.get_height(c, r));
+						differences[i] = after.get_height(c, r) - before.get_height(c, r);
+					}
+					// calculating normal
+					glm::vec3 n = glm::vec3(glm::normalize(glm::cross(points[1] - points[0], points[2] - points[0])));
+
+					for (int i = 0; i < 3; ++i)
+					{
+						glm::vec3 position = glm::vec3((points[i] - min) * 2.0 / extent - 1.0);
+						glm::vec3 color = difference_color(differences[i] / max_difference);
+						*out++ = position.x;
+						*out++ = position.y;
+						*out++ = position.z;
+						*out++ = n.x;
+						*out++ = n.y;
+						*out++ = n.z;
+						*out++ = color.r;
+						*out++ = color.g;
+						*out++ = color.b;
+					}
+				}
+			}
+		}
+	}, 1);
+
+	return vertices;
+}
+
+const Height_grid& Survey_comparison::get_before() const
+{
+	return before;
+}
+
+const Height_grid& Survey_comparison::get_after() const
+{
+	return after;
+}
+
+bool Survey_comparison::_is_covered(size_t col, size_t row) const
+{
+	return before.has_height(col, row) && after.has_height(col, row);
+}
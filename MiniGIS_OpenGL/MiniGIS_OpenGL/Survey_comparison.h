@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Height_grid.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Cut/fill results of a survey comparison. Differences are after - before, so cut is negative and fill is positive.
+struct Volume_statistics
+{
+	double cut_volume = 0.0;
+	double fill_volume = 0.0;
+	double cut_area = 0.0;
+	double fill_area = 0.0;
+	// area covered by both surveys
+	double overlap_area = 0.0;
+	double min_difference = 0.0;
+	double max_difference = 0.0;
+	double mean_difference = 0.0;
+	double rms_difference = 0.0;
+	size_t cell_count = 0;
+};
+
+// Compares two surveys of the same site by gridding both of them on a common lattice over the overlap of their extents
+class Survey_comparison
+{
+public:
+	// Grids both surveys. A cell_size of zero derives the cell size from the point density of the sparser survey.
+	Survey_comparison(const std::vector<glm::dvec3>& before, const std::vector<glm::dvec3>& after, double cell_size = 0.0);
+
+	// Accumulates cut and fill volumes, areas and difference statistics over the cells covered by both surveys
+	Volume_statistics compute_statistics() const;
+
+	// Triangulates the after surface over the overlap. Every vertex holds position, normal and a color mapped
+	// from the height difference (blue for cut, red for fill), positions are scaled to [-1, 1] like the reconstructed mesh.
+	std::vector<float> build_difference_mesh() const;
+
+	const Height_grid& get_before() const;
+	const Height_grid& get_after() const;
+
+private:
+	Height_grid before;
+	Height_grid after;
+
+	bool _is_covered(size_t col, size_t row) const;
+};
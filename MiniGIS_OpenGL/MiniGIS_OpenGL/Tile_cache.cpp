@@ -0,0 +1,435 @@
+#include "Tile_cache.h"
+#include "Frustum.h"
+
+#include <soil.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+
+namespace
+{
+	// tiles smaller than a screen pixel per texel are not refined any further
+	const float MAX_TEXEL_PIXELS = 1.0f;
+
+	double get_seconds()
+	{
+		return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+// Reads <directory>/tileset.txt. Returns false and reports the reason if it is missing or incomplete, or if its
+// coarsest level has more tiles than slot_count atlas slots, so the whole terrain could never be shown.
+bool Tileset::load(const string& directory, size_t slot_count)
+{
+	this->directory = directory;
+	string path = directory + "/tileset.txt";
+	ifstream file(path);
+	if (!file)
+	{
+		cout << "Failed to open tileset: " << path << endl;
+		return false;
+	}
+
+	string line;
+	while (getline(file, line))
+	{
+		istringstream stream(line);
+		string key;
+		if (!(stream >> key) || key[0] == '#')
+		{
+			continue;
+		}
+		if (key == "width") stream >> width;
+		else if (key == "height") stream >> height;
+		else if (key == "tile_size") stream >> tile_size;
+		else if (key == "levels") stream >> levels;
+		else if (key == "origin_x") stream >> origin_x;
+		else if (key == "origin_y") stream >> origin_y;
+		else if (key == "pixel_size_x") stream >> pixel_size_x;
+		else if (key == "pixel_size_y") stream >> pixel_size_y;
+		else if (key == "format") stream >> format;
+		else
+		{
+			cout << "Unknown tileset key: " << key << endl;
+		}
+	}
+
+	if (width <= 0 || height <= 0 || tile_size <= 0 || levels <= 0 || pixel_size_x == 0.0 || pixel_size_y == 0.0)
+	{
+		cout << "Incomplete tileset: " << path << endl;
+		return false;
+	}
+	size_t top_tiles = size_t(get_cols(levels - 1)) * get_rows(levels - 1);
+	if (top_tiles > slot_count)
+	{
+		cout << "Tileset has " << top_tiles << " tiles at its coarsest level but the atlas only " << slot_count
+			<< " slots, add pyramid levels: " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+int Tileset::get_cols(int level) const
+{
+	int level_tile = tile_size << level;
+	return (width + level_tile - 1) / level_tile;
+}
+
+int Tileset::get_rows(int level) const
+{
+	int level_tile = tile_size << level;
+	return (height + level_tile - 1) / level_tile;
+}
+
+string Tileset::get_tile_path(int level, int col, int row) const
+{
+	return directory + "/" + to_string(level) + "/" + to_string(col) + "_" + to_string(row) + "." + format;
+}
+
+Tile_cache::Tile_cache(const Tileset& tileset, size_t slot_count, size_t worker_count) :
+	tileset(tileset), slot_count(slot_count), frame(0), frame_tiles(0), dropped_frame(0), stopping(false), decode_seconds(0.0),
+	decoded_tiles(0), hits(0), misses(0), evictions(0), dropped(0), start_time(get_seconds())
+{
+	// slots are handed out from the back, so the first tiles land in slot 0, 1, ...
+	for (size_t slot = slot_count; slot > 0; --slot)
+	{
+		free_slots.push_back(int(slot - 1));
+	}
+
+	worker_count = max<size_t>(worker_count, 1);
+	for (size_t i = 0; i < worker_count; ++i)
+	{
+		workers.emplace_back(&Tile_cache::_decode_tiles, this);
+	}
+}
+
+Tile_cache::~Tile_cache()
+{
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		stopping = true;
+	}
+	queue_changed.notify_all();
+	for (thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+// Starts a frame. Requests of the previous frame that no worker has started yet are dropped.
+void Tile_cache::begin_frame()
+{
+	++frame;
+	frame_tiles = 0;
+	lock_guard<mutex> lock(queue_mutex);
+	for (const Tile_key& key : queued)
+	{
+		requested.erase(key);
+	}
+	queued.clear();
+}
+
+// Requests the tiles over the xy extent of the terrain that are inside the view frustum, refined while a texel of
+// a tile would cover more than one screen pixel. Tiles are selected level by level from the coarsest one, the tiles
+// that look coarsest are refined first and refinement stops when the slots are used up, so the tiles of a frame
+// never evict each other.
+void Tile_cache::request_visible(const glm::vec3& camera_position, const glm::mat4& mesh_to_clip, float projection_scale,
+	const glm::dvec3& mesh_min, const glm::dvec3& mesh_max)
+{
+	// the coarsest level is requested everywhere, also outside of the frustum, so every part of the terrain has
+	// something to show when the view turns. Only if it does not fit into the slots it is culled like the finer levels.
+	int top = tileset.levels - 1;
+	bool top_fits = size_t(tileset.get_cols(top)) * tileset.get_rows(top) <= slot_count;
+	vector<Tile_key> level_tiles;
+	for (int row = 0; row < tileset.get_rows(top); ++row)
+	{
+		for (int col = 0; col < tileset.get_cols(top); ++col)
+		{
+			level_tiles.push_back(Tile_key{ top, col, row });
+		}
+	}
+
+	size_t selected = 0;
+	vector<pair<double, Tile_key>> level_pixels;
+	vector<pair<double, Tile_key>> candidates;
+	vector<Tile_key> refined;
+	while (!level_tiles.empty())
+	{
+		level_pixels.clear();
+		for (const Tile_key& key : level_tiles)
+		{
+			const glm::mat4* frustum = key.level == top && top_fits ? nullptr : &mesh_to_clip;
+			double texel_pixels = _get_texel_pixels(key, camera_position, frustum, projection_scale, mesh_min, mesh_max);
+			if (texel_pixels >= 0.0)
+			{
+				level_pixels.push_back(make_pair(texel_pixels, key));
+			}
+		}
+
+		// the coarsest looking tiles are requested and refined first, as long as there are slots for them
+		sort(level_pixels.begin(), level_pixels.end(),
+			[](const pair<double, Tile_key>& a, const pair<double, Tile_key>& b) { return a.first > b.first; });
+		candidates.clear();
+		for (const auto& tile : level_pixels)
+		{
+			if (selected == slot_count)
+			{
+				break;
+			}
+			double texel_pixels = tile.first;
+			const Tile_key& key = tile.second;
+			request(key);
+			++selected;
+			if (key.level > 0 && texel_pixels > MAX_TEXEL_PIXELS)
+			{
+				candidates.push_back(make_pair(texel_pixels, key));
+			}
+		}
+
+		refined.clear();
+		for (const auto& candidate : candidates)
+		{
+			const Tile_key& key = candidate.second;
+			int level = key.level - 1;
+			size_t first_child = refined.size();
+			for (int row = key.row * 2; row < min(key.row * 2 + 2, tileset.get_rows(level)); ++row)
+			{
+				for (int col = key.col * 2; col < min(key.col * 2 + 2, tileset.get_cols(level)); ++col)
+				{
+					refined.push_back(Tile_key{ level, col, row });
+				}
+			}
+			if (selected + refined.size() > slot_count)
+			{
+				refined.resize(first_child);
+				break;
+			}
+		}
+		level_tiles.swap(refined);
+	}
+}
+
+// Marks a tile as used in this frame. Returns its slot if it is resident, otherwise queues it for decoding and returns -1.
+int Tile_cache::request(const Tile_key& key)
+{
+	auto found = resident.find(key);
+	if (found != resident.end())
+	{
+		++hits;
+		if (found->second.last_frame != frame)
+		{
+			found->second.last_frame = frame;
+			++frame_tiles;
+		}
+		lru.splice(lru.begin(), lru, found->second.lru_position);
+		return found->second.slot;
+	}
+
+	++misses;
+	if (missing.count(key) == 0 && frame_tiles < slot_count)
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		if (requested.insert(key).second)
+		{
+			queued.push_back(key);
+			queue_changed.notify_one();
+		}
+	}
+	return -1;
+}
+
+// Returns the slot of a resident tile or -1, without marking it as used
+int Tile_cache::find(const Tile_key& key) const
+{
+	auto found = resident.find(key);
+	return found == resident.end() ? -1 : found->second.slot;
+}
+
+// Moves at most max_tiles decoded tiles into slots and calls upload(slot, pixels) for each of them.
+// Returns the tiles that became resident or were evicted.
+vector<Tile_key> Tile_cache::commit(size_t max_tiles, const function<void(int, const vector<unsigned char>&)>& upload)
+{
+	vector<Tile_key> changed;
+	for (size_t i = 0; i < max_tiles; ++i)
+	{
+		Decoded tile;
+		{
+			lock_guard<mutex> lock(queue_mutex);
+			if (decoded.empty())
+			{
+				break;
+			}
+			tile = move(decoded.front());
+			decoded.pop_front();
+			requested.erase(tile.key);
+		}
+
+		if (!tile.valid)
+		{
+			missing.insert(tile.key);
+			continue;
+		}
+
+		if (free_slots.empty())
+		{
+			// tiles used in this frame are never evicted, a tile that finds no slot is requested again later
+			const Tile_key& oldest = lru.back();
+			auto victim = resident.find(oldest);
+			if (victim->second.last_frame == frame)
+			{
+				++dropped;
+				dropped_frame = frame;
+				continue;
+			}
+			free_slots.push_back(victim->second.slot);
+			changed.push_back(oldest);
+			resident.erase(victim);
+			lru.pop_back();
+			++evictions;
+		}
+
+		int slot = free_slots.back();
+		free_slots.pop_back();
+		upload(slot, tile.pixels);
+		lru.push_front(tile.key);
+		resident[tile.key] = Resident{ slot, frame, lru.begin() };
+		++frame_tiles;
+		changed.push_back(tile.key);
+	}
+	return changed;
+}
+
+// Returns whether tiles are queued or being decoded that can still be placed. After a tile found no slot in this
+// frame, loading more has to wait for the view to change.
+bool Tile_cache::is_busy() const
+{
+	if (dropped_frame == frame)
+	{
+		return false;
+	}
+	lock_guard<mutex> lock(queue_mutex);
+	return !requested.empty();
+}
+
+const Tileset& Tile_cache::get_tileset() const
+{
+	return tileset;
+}
+
+size_t Tile_cache::get_slot_count() const
+{
+	return slot_count;
+}
+
+// Prints the hit rate of the requests and the decode throughput
+void Tile_cache::print_statistics() const
+{
+	double elapsed = get_seconds() - start_time;
+	double thread_seconds;
+	size_t tiles;
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		thread_seconds = decode_seconds;
+		tiles = decoded_tiles;
+	}
+	size_t requests = hits + misses;
+	double megapixels = tiles * double(tileset.tile_size) * tileset.tile_size / 1e6;
+	cout << "tiles: " << requests << " requests, hit rate " << (requests > 0 ? 100.0 * hits / requests : 0.0)
+		<< " %, " << resident.size() << " of " << slot_count << " slots used, " << evictions << " evictions, "
+		<< dropped << " dropped, " << missing.size() << " missing" << endl;
+	cout << "tiles: decoded " << tiles << " tiles on " << workers.size() << " threads, "
+		<< (elapsed > 0.0 ? tiles / elapsed : 0.0) << " tiles/s, "
+		<< (thread_seconds > 0.0 ? megapixels / thread_seconds : 0.0) << " Mpixel/s per thread" << endl;
+}
+
+void Tile_cache::_decode_tiles()
+{
+	size_t tile_size = size_t(tileset.tile_size);
+	while (true)
+	{
+		Tile_key key;
+		{
+			unique_lock<mutex> lock(queue_mutex);
+			queue_changed.wait(lock, [this] { return stopping || !queued.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+			key = queued.front();
+			queued.pop_front();
+		}
+
+		double start = get_seconds();
+		Decoded tile{ key, false, {} };
+		string path = tileset.get_tile_path(key.level, key.col, key.row);
+		int width, height, channels;
+		unsigned char* data = SOIL_load_image(path.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+		if (data)
+		{
+			// edge tiles may be smaller than tile_size, their last row and column are repeated
+			tile.valid = true;
+			tile.pixels.resize(tile_size * tile_size * 4);
+			for (size_t y = 0; y < tile_size; ++y)
+			{
+				size_t source_y = min<size_t>(y, size_t(height) - 1);
+				for (size_t x = 0; x < tile_size; ++x)
+				{
+					size_t source_x = min<size_t>(x, size_t(width) - 1);
+					const unsigned char* source = data + (source_y * size_t(width) + source_x) * 4;
+					copy(source, source + 4, tile.pixels.begin() + (y * tile_size + x) * 4);
+				}
+			}
+			SOIL_free_image_data(data);
+		}
+		else
+		{
+			cout << "Failed to load tile: " << path << endl;
+		}
+
+		lock_guard<mutex> lock(queue_mutex);
+		decode_seconds += get_seconds() - start;
+		decoded_tiles += tile.valid ? 1 : 0;
+		decoded.push_back(move(tile));
+	}
+}
+
+// Returns the projected size in pixels of a texel of the tile at its point closest to the camera, or a negative
+// value if the tile lies beside the terrain or, with mesh_to_clip given, outside of the view frustum.
+// The tile is a box over the height range of the terrain, [-1, 1] in normalized mesh coordinates.
+double Tile_cache::_get_texel_pixels(const Tile_key& key, const glm::vec3& camera_position, const glm::mat4* mesh_to_clip,
+	float projection_scale, const glm::dvec3& mesh_min, const glm::dvec3& mesh_max) const
+{
+	// tile extent in world coordinates
+	double tile_world_x = tileset.pixel_size_x * (tileset.tile_size << key.level);
+	double tile_world_y = tileset.pixel_size_y * (tileset.tile_size << key.level);
+	double x0 = tileset.origin_x + key.col * tile_world_x;
+	double x1 = x0 + tile_world_x;
+	double y0 = tileset.origin_y + key.row * tile_world_y;
+	double y1 = y0 + tile_world_y;
+
+	// and in normalized mesh coordinates
+	glm::dvec3 extent = mesh_max - mesh_min;
+	glm::dvec3 box_min((min(x0, x1) - mesh_min.x) * 2.0 / extent.x - 1.0, (min(y0, y1) - mesh_min.y) * 2.0 / extent.y - 1.0, -1.0);
+	glm::dvec3 box_max((max(x0, x1) - mesh_min.x) * 2.0 / extent.x - 1.0, (max(y0, y1) - mesh_min.y) * 2.0 / extent.y - 1.0, 1.0);
+	if (box_max.x < -1.0 || box_min.x > 1.0 || box_max.y < -1.0 || box_min.y > 1.0)
+	{
+		return -1.0;
+	}
+
+	if (mesh_to_clip && is_box_outside_frustum(*mesh_to_clip, glm::vec3(box_min), glm::vec3(box_max)))
+	{
+		return -1.0;
+	}
+
+	glm::dvec3 camera(camera_position.x, camera_position.y, camera_position.z);
+	double distance = max(glm::length(camera - glm::clamp(camera, box_min, box_max)), 1e-6);
+	double texel = abs(tile_world_x) / tileset.tile_size * 2.0 / extent.x;
+	return texel / distance * projection_scale;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A georeferenced image pyramid cut into square tiles. Level 0 is the full resolution, every further level halves it.
+// Tiles are stored as <directory>/<level>/<col>_<row>.<format>, row 0 at the top (north) of the image.
+// The description is read from <directory>/tileset.txt, one "key value" pair per line:
+//   width, height     size of the full resolution image in pixels
+//   tile_size         tile width and height in pixels
+//   levels            number of pyramid levels
+//   origin_x/y        world position of the top left image corner
+//   pixel_size_x/y    world size of a full resolution pixel, pixel_size_y is negative for north-up images
+//   format            file extension of the tiles, png by default
+struct Tileset
+{
+	std::string directory;
+	int width = 0;
+	int height = 0;
+	int tile_size = 256;
+	int levels = 1;
+	double origin_x = 0.0;
+	double origin_y = 0.0;
+	double pixel_size_x = 1.0;
+	double pixel_size_y = -1.0;
+	std::string format = "png";
+
+	// Reads <directory>/tileset.txt. Returns false and reports the reason if it is missing or incomplete, or if its
+	// coarsest level has more tiles than slot_count atlas slots, so the whole terrain could never be shown.
+	bool load(const std::string& directory, size_t slot_count);
+
+	int get_cols(int level) const;
+	int get_rows(int level) const;
+	std::string get_tile_path(int level, int col, int row) const;
+};
+
+struct Tile_key
+{
+	int level;
+	int col;
+	int row;
+
+	bool operator==(const Tile_key& other) const
+	{
+		return level == other.level && col == other.col && row == other.row;
+	}
+};
+
+struct Tile_key_hash
+{
+	size_t operator()(const Tile_key& key) const
+	{
+		return std::hash<uint64_t>()((uint64_t(key.level) << 48) ^ (uint64_t(key.col) << 24) ^ uint64_t(key.row));
+	}
+};
+
+// Keeps the tiles of a tileset in a fixed number of atlas slots. Tiles are decoded on worker threads, the slot of
+// the least recently used tile is reused when the atlas is full. The cache itself does not touch OpenGL, the caller
+// copies committed tiles into its atlas texture.
+class Tile_cache
+{
+public:
+	Tile_cache(const Tileset& tileset, size_t slot_count, size_t worker_count);
+	~Tile_cache();
+
+	Tile_cache(const Tile_cache&) = delete;
+	Tile_cache& operator=(const Tile_cache&) = delete;
+
+	// Starts a frame. Requests of the previous frame that no worker has started yet are dropped.
+	void begin_frame();
+
+	// Requests the tiles over the xy extent of the terrain that are inside the view frustum, refined while a texel of
+	// a tile would cover more than one screen pixel and the refined tiles still fit into the slots. At most slot_count
+	// tiles are requested, the ones that look coarsest first. A tile spans the
+	// height range of the terrain. camera_position is in normalized mesh coordinates ([-1, 1] over mesh_min..mesh_max),
+	// mesh_to_clip maps them to clip space and projection_scale is the screen height in pixels divided by 2 tan(fov / 2).
+	void request_visible(const glm::vec3& camera_position, const glm::mat4& mesh_to_clip, float projection_scale,
+		const glm::dvec3& mesh_min, const glm::dvec3& mesh_max);
+
+	// Marks a tile as used in this frame. Returns its slot if it is resident, otherwise queues it for decoding and returns -1.
+	int request(const Tile_key& key);
+
+	// Returns the slot of a resident tile or -1, without marking it as used
+	int find(const Tile_key& key) const;
+
+	// Moves at most max_tiles decoded tiles into slots and calls upload(slot, pixels) for each of them, pixels being
+	// tile_size x tile_size RGBA. Returns the tiles that became resident or were evicted.
+	std::vector<Tile_key> commit(size_t max_tiles, const std::function<void(int, const std::vector<unsigned char>&)>& upload);
+
+	// Returns whether tiles are queued or being decoded that can still be placed. After a tile found no slot in this
+	// frame, loading more has to wait for the view to change.
+	bool is_busy() const;
+
+	const Tileset& get_tileset() const;
+	size_t get_slot_count() const;
+
+	// Prints the hit rate of the requests and the decode throughput
+	void print_statistics() const;
+
+private:
+	struct Resident
+	{
+		int slot;
+		size_t last_frame;
+		std::list<Tile_key>::iterator lru_position;
+	};
+
+	struct Decoded
+	{
+		Tile_key key;
+		bool valid;
+		std::vector<unsigned char> pixels;
+	};
+
+	Tileset tileset;
+	size_t slot_count;
+	size_t frame;
+
+	// only touched by the caller thread
+	std::unordered_map<Tile_key, Resident, Tile_key_hash> resident;
+	// most recently used first
+	std::list<Tile_key> lru;
+	std::vector<int> free_slots;
+	std::unordered_set<Tile_key, Tile_key_hash> missing;
+	// resident tiles used in this frame, no tile is queued once they fill all slots
+	size_t frame_tiles;
+	// last frame a decoded tile was dropped in, frames start at 1
+	size_t dropped_frame;
+
+	// shared with the workers, guarded by queue_mutex
+	mutable std::mutex queue_mutex;
+	std::condition_variable queue_changed;
+	std::deque<Tile_key> queued;
+	std::unordered_set<Tile_key, Tile_key_hash> requested;
+	std::deque<Decoded> decoded;
+	bool stopping;
+	double decode_seconds;
+	size_t decoded_tiles;
+
+	std::vector<std::thread> workers;
+
+	// statistics
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+	size_t dropped;
+	double start_time;
+
+	void _decode_tiles();
+	double _get_texel_pixels(const Tile_key& key, const glm::vec3& camera_position, const glm::mat4* mesh_to_clip,
+		float projection_scale, const glm::dvec3& mesh_min, const glm::dvec3& mesh_max) const;
+};
@@ -0,0 +1,189 @@
+#include "Triangle_bvh.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+
+namespace
+{
+	const size_t LEAF_SIZE = 4;
+	const size_t MAX_DEPTH = 64;
+
+	bool intersects_triangle(const glm::vec3& origin, const glm::vec3& direction, float max_distance,
+		const glm::vec3& v0, const glm::vec3& e1, const glm::vec3& e2)
+	{
+		// Moeller-Trumbore
+		const float epsilon = 1e-7f;
+		glm::vec3 p = glm::cross(direction, e2);
+		float determinant = glm::dot(e1, p);
+		if (determinant > -epsilon && determinant < epsilon)
+		{
+			return false;
+		}
+		float inverse = 1.0f / determinant;
+		glm::vec3 s = origin - v0;
+		float u = glm::dot(s, p) * inverse;
+		if (u < 0.0f || u > 1.0f)
+		{
+			return false;
+		}
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(direction, q) * inverse;
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			return false;
+		}
+		float t = glm::dot(e2, q) * inverse;
+		return t > epsilon && t < max_distance;
+	}
+
+	bool intersects_box(const glm::vec3& origin, const glm::vec3& inverse_direction, float max_distance,
+		const glm::vec3& min, const glm::vec3& max)
+	{
+		float t_min = 0.0f;
+		float t_max = max_distance;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float t0 = (min[axis] - origin[axis]) * inverse_direction[axis];
+			float t1 = (max[axis] - origin[axis]) * inverse_direction[axis];
+			if (t0 > t1)
+			{
+				swap(t0, t1);
+			}
+			t_min = std::max(t_min, t0);
+			t_max = std::min(t_max, t1);
+			if (t_min > t_max)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+// Builds the hierarchy by splitting the triangles at the median of their centroids along the longest axis
+Triangle_bvh::Triangle_bvh(const vector<glm::vec3>& positions, const vector<unsigned int>& indices)
+{
+	size_t triangle_count = indices.size() / 3;
+	vector<Triangle> source(triangle_count);
+	vector<glm::vec3> centroids(triangle_count);
+	vector<unsigned int> order(triangle_count);
+	for (size_t i = 0; i < triangle_count; ++i)
+	{
+		const glm::vec3& a = positions[indices[3 * i]];
+		const glm::vec3& b = positions[indices[3 * i + 1]];
+		const glm::vec3& c = positions[indices[3 * i + 2]];
+		source[i].v0 = a;
+		source[i].e1 = b - a;
+		source[i].e2 = c - a;
+		centroids[i] = (a + b + c) / 3.0f;
+		order[i] = (unsigned int)i;
+	}
+
+	nodes.reserve(triangle_count / LEAF_SIZE * 2 + 1);
+	if (triangle_count > 0)
+	{
+		_build(order, centroids, source, 0, triangle_count);
+	}
+
+	// store the triangles in leaf order, so a leaf reads one contiguous block
+	triangles.resize(triangle_count);
+	for (size_t i = 0; i < triangle_count; ++i)
+	{
+		triangles[i] = source[order[i]];
+	}
+}
+
+// Returns whether the ray hits any triangle closer than max_distance. direction has to be normalized.
+bool Triangle_bvh::is_occluded(const glm::vec3& origin, const glm::vec3& direction, float max_distance) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	glm::vec3 inverse_direction(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	unsigned int stack[MAX_DEPTH * 2];
+	size_t top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		unsigned int index = stack[--top];
+		const Node& node = nodes[index];
+		if (!intersects_box(origin, inverse_direction, max_distance, node.min, node.max))
+		{
+			continue;
+		}
+		if (node.count > 0)
+		{
+			for (unsigned int i = node.first; i < node.first + node.count; ++i)
+			{
+				const Triangle& triangle = triangles[i];
+				if (intersects_triangle(origin, direction, max_distance, triangle.v0, triangle.e1, triangle.e2))
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			stack[top++] = node.first;
+			stack[top++] = index + 1;
+		}
+	}
+	return false;
+}
+
+unsigned int Triangle_bvh::_build(vector<unsigned int>& order, const vector<glm::vec3>& centroids,
+	const vector<Triangle>& source, size_t begin, size_t end)
+{
+	unsigned int index = (unsigned int)nodes.size();
+	nodes.push_back(Node());
+
+	glm::vec3 min(numeric_limits<float>::max());
+	glm::vec3 max(-numeric_limits<float>::max());
+	glm::vec3 centroid_min = min;
+	glm::vec3 centroid_max = max;
+	for (size_t i = begin; i < end; ++i)
+	{
+		const Triangle& triangle = source[order[i]];
+		glm::vec3 b = triangle.v0 + triangle.e1;
+		glm::vec3 c = triangle.v0 + triangle.e2;
+		min = glm::min(min, glm::min(triangle.v0, glm::min(b, c)));
+		max = glm::max(max, glm::max(triangle.v0, glm::max(b, c)));
+		centroid_min = glm::min(centroid_min, centroids[order[i]]);
+		centroid_max = glm::max(centroid_max, centroids[order[i]]);
+	}
+	nodes[index].min = min;
+	nodes[index].max = max;
+
+	glm::vec3 extent = centroid_max - centroid_min;
+	if (end - begin <= LEAF_SIZE || (extent.x <= 0.0f && extent.y <= 0.0f && extent.z <= 0.0f))
+	{
+		nodes[index].first = (unsigned int)begin;
+		nodes[index].count = (unsigned int)(end - begin);
+		return index;
+	}
+
+	int axis = 0;
+	if (extent.y > extent[axis])
+	{
+		axis = 1;
+	}
+	if (extent.z > extent[axis])
+	{
+		axis = 2;
+	}
+	size_t middle = begin + (end - begin) / 2;
+	nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+		[&](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+	// the left child always follows its parent
+	_build(order, centroids, source, begin, middle);
+	unsigned int right = _build(order, centroids, source, middle, end);
+	nodes[index].first = right;
+	nodes[index].count = 0;
+	return index;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Bounding volume hierarchy over the triangles of a mesh, used to answer occlusion queries while baking
+class Triangle_bvh
+{
+public:
+	// Builds the hierarchy by splitting the triangles at the median of their centroids along the longest axis
+	Triangle_bvh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+	// Returns whether the ray hits any triangle closer than max_distance. direction has to be normalized.
+	bool is_occluded(const glm::vec3& origin, const glm::vec3& direction, float max_distance) const;
+
+private:
+	// A leaf holds count triangles starting at first, an inner node (count == 0) has its left child
+	// right after itself and its right child at first
+	struct Node
+	{
+		glm::vec3 min;
+		unsigned int first;
+		glm::vec3 max;
+		unsigned int count;
+	};
+
+	// Stored as one vertex and two edges for the ray intersection test
+	struct Triangle
+	{
+		glm::vec3 v0;
+		glm::vec3 e1;
+		glm::vec3 e2;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+
+	unsigned int _build(std::vector<unsigned int>& order, const std::vector<glm::vec3>& centroids,
+		const std::vector<Triangle>& source, size_t begin, size_t end);
+};
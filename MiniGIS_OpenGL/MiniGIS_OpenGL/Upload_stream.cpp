@@ -0,0 +1,217 @@
+#include "Upload_stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+
+// Allocates the device buffer and starts the worker. Must be called on the GL thread.
+Upload_stream::Upload_stream(shared_ptr<const vector<float>> data, size_t segment_size, size_t segment_count, size_t frame_budget) :
+	data(data), total_bytes(data->size() * sizeof(float)), uploaded_bytes(0), segment_size(segment_size),
+	frame_budget(frame_budget), persistent(GLEW_ARB_buffer_storage != 0), buffer(0), staging_buffer(0), staging(nullptr),
+	segments(segment_count), cancelled(false), start_time(glfwGetTime()), finish_time(0.0), longest_pump(0.0)
+{
+	// device resident destination
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, total_bytes, nullptr, GL_STATIC_DRAW);
+
+	size_t ring_size = segment_size * segment_count;
+	if (persistent)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &staging_buffer);
+		glBindBuffer(GL_COPY_READ_BUFFER, staging_buffer);
+		glBufferStorage(GL_COPY_READ_BUFFER, ring_size, nullptr, flags);
+		staging = static_cast<char*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, ring_size, flags));
+	}
+	if (staging == nullptr)
+	{
+		if (persistent)
+		{
+			glDeleteBuffers(1, &staging_buffer);
+			staging_buffer = 0;
+			persistent = false;
+		}
+		client_staging.resize(ring_size);
+		staging = client_staging.data();
+	}
+
+	for (size_t i = 0; i < segment_count; ++i)
+	{
+		segments[i].fence = nullptr;
+		free_segments.push_back(i);
+	}
+	if (total_bytes == 0)
+	{
+		finish_time = start_time;
+		this->data.reset();
+		return;
+	}
+	worker = thread(&Upload_stream::_write_segments, this);
+}
+
+Upload_stream::~Upload_stream()
+{
+	{
+		lock_guard<mutex> lock(segments_mutex);
+		cancelled = true;
+	}
+	segment_freed.notify_all();
+	if (worker.joinable())
+	{
+		worker.join();
+	}
+
+	// wait for the copies still in flight, so every fence has signaled
+	glFinish();
+	_recycle_segments();
+	if (staging_buffer != 0)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, staging_buffer);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glDeleteBuffers(1, &staging_buffer);
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+// Recycles finished segments and copies filled ones into the device buffer, at most frame_budget bytes per call.
+// Call once per frame on the GL thread.
+void Upload_stream::pump()
+{
+	if (is_finished() && pending_segments.empty())
+	{
+		return;
+	}
+	double pump_start = glfwGetTime();
+
+	_recycle_segments();
+
+	size_t budget = frame_budget;
+	while (budget > 0)
+	{
+		size_t index;
+		{
+			lock_guard<mutex> lock(segments_mutex);
+			if (filled_segments.empty())
+			{
+				break;
+			}
+			index = filled_segments.front();
+			filled_segments.pop_front();
+		}
+
+		Segment& segment = segments[index];
+		size_t ring_offset = index * segment_size;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		if (persistent)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, staging_buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, ring_offset, segment.destination, segment.size);
+			segment.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+		else
+		{
+			// the driver copies client memory before glBufferSubData returns
+			glBufferSubData(GL_COPY_WRITE_BUFFER, segment.destination, segment.size, staging + ring_offset);
+		}
+		pending_segments.push_back(index);
+		uploaded_bytes += segment.size;
+		budget -= std::min(budget, segment.size);
+	}
+
+	_recycle_segments();
+	if (is_finished() && finish_time == 0.0)
+	{
+		finish_time = glfwGetTime();
+	}
+	longest_pump = std::max(longest_pump, glfwGetTime() - pump_start);
+}
+
+bool Upload_stream::is_finished() const
+{
+	return uploaded_bytes == total_bytes;
+}
+
+// The data is uploaded front to back, so [0, get_uploaded_bytes()) of the device buffer can already be drawn
+size_t Upload_stream::get_uploaded_bytes() const
+{
+	return uploaded_bytes;
+}
+
+size_t Upload_stream::get_total_bytes() const
+{
+	return total_bytes;
+}
+
+unsigned int Upload_stream::get_buffer() const
+{
+	return buffer;
+}
+
+// Prints the uploaded bytes, also when there were none, the throughput, the staging path used and the longest time
+// pump() blocked the render loop
+void Upload_stream::print_statistics() const
+{
+	double elapsed = (finish_time > 0.0 ? finish_time : glfwGetTime()) - start_time;
+	cout << "upload: " << uploaded_bytes / (1024.0 * 1024.0) << " of " << total_bytes / (1024.0 * 1024.0) << " MB in "
+		<< elapsed * 1000.0 << " ms (" << (elapsed > 0.0 ? uploaded_bytes / (1024.0 * 1024.0) / elapsed : 0.0) << " MB/s, "
+		<< (persistent ? "persistent mapped ring" : "fallback: glBufferSubData from a client memory ring") << "), longest frame slice "
+		<< longest_pump * 1000.0 << " ms" << endl;
+}
+
+void Upload_stream::_write_segments()
+{
+	const char* source = reinterpret_cast<const char*>(data->data());
+	for (size_t offset = 0; offset < total_bytes; offset += segment_size)
+	{
+		size_t index;
+		{
+			unique_lock<mutex> lock(segments_mutex);
+			segment_freed.wait(lock, [this] { return cancelled || !free_segments.empty(); });
+			if (cancelled)
+			{
+				return;
+			}
+			index = free_segments.front();
+			free_segments.pop_front();
+		}
+
+		Segment& segment = segments[index];
+		segment.destination = offset;
+		segment.size = std::min(segment_size, total_bytes - offset);
+		memcpy(staging + index * segment_size, source + offset, segment.size);
+
+		lock_guard<mutex> lock(segments_mutex);
+		filled_segments.push_back(index);
+	}
+	// every byte is in the ring now, the caller decides whether it keeps its own copy
+	data.reset();
+}
+
+void Upload_stream::_recycle_segments()
+{
+	while (!pending_segments.empty())
+	{
+		Segment& segment = segments[pending_segments.front()];
+		if (segment.fence != nullptr)
+		{
+			GLenum status = glClientWaitSync(segment.fence, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			{
+				// copies finish in order, so the later ones are not done either
+				break;
+			}
+			glDeleteSync(segment.fence);
+			segment.fence = nullptr;
+		}
+		{
+			lock_guard<mutex> lock(segments_mutex);
+			free_segments.push_back(pending_segments.front());
+		}
+		pending_segments.pop_front();
+		segment_freed.notify_one();
+	}
+}
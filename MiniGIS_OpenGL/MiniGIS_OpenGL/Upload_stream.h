@@ -0,0 +1,83 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Streams vertex data into a device buffer without stalling the render loop.
+// A worker thread copies the data into a ring of staging segments that are persistently mapped (GL_ARB_buffer_storage),
+// the GL thread copies filled segments into the device buffer in bounded slices per frame and hands a segment back
+// to the worker once the fence of its copy has signaled. Without GL_ARB_buffer_storage the segments live in client
+// memory and are uploaded with glBufferSubData.
+class Upload_stream
+{
+public:
+	// Allocates the device buffer and starts the worker. Must be called on the GL thread.
+	Upload_stream(std::shared_ptr<const std::vector<float>> data, size_t segment_size = 4 << 20, size_t segment_count = 8,
+		size_t frame_budget = 32 << 20);
+	~Upload_stream();
+
+	Upload_stream(const Upload_stream&) = delete;
+	Upload_stream& operator=(const Upload_stream&) = delete;
+
+	// Recycles finished segments and copies filled ones into the device buffer, at most frame_budget bytes per call.
+	// Call once per frame on the GL thread.
+	void pump();
+
+	bool is_finished() const;
+
+	// The data is uploaded front to back, so [0, get_uploaded_bytes()) of the device buffer can already be drawn
+	size_t get_uploaded_bytes() const;
+	size_t get_total_bytes() const;
+	unsigned int get_buffer() const;
+
+	// Prints the uploaded bytes, also when there were none, the throughput, the staging path used and the longest time
+	// pump() blocked the render loop
+	void print_statistics() const;
+
+private:
+	struct Segment
+	{
+		size_t destination;
+		size_t size;
+		GLsync fence;
+	};
+
+	std::shared_ptr<const std::vector<float>> data;
+	size_t total_bytes;
+	size_t uploaded_bytes;
+	size_t segment_size;
+	size_t frame_budget;
+	bool persistent;
+
+	unsigned int buffer;
+	unsigned int staging_buffer;
+	char* staging;
+	std::vector<char> client_staging;
+	std::vector<Segment> segments;
+
+	// segment indices, guarded by segments_mutex
+	std::mutex segments_mutex;
+	std::condition_variable segment_freed;
+	std::deque<size_t> free_segments;
+	std::deque<size_t> filled_segments;
+	bool cancelled;
+	// only touched by the GL thread
+	std::deque<size_t> pending_segments;
+
+	std::thread worker;
+
+	// statistics
+	double start_time;
+	double finish_time;
+	double longest_pump;
+
+	void _write_segments();
+	void _recycle_segments();
+};
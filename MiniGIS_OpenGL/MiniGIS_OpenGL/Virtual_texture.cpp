@@ -0,0 +1,151 @@
+#include "Virtual_texture.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+
+namespace
+{
+	// decoded tiles copied into the atlas per frame, bounds the time a frame spends in glTexSubImage2D
+	const size_t TILES_PER_FRAME = 8;
+}
+
+// Creates the atlas and page table textures and starts the tile decoders. mesh_min and mesh_max are the world
+// extent of the normalized mesh. Must be called on the GL thread.
+Virtual_texture::Virtual_texture(const Tileset& tileset, const glm::dvec3& mesh_min, const glm::dvec3& mesh_max,
+	int atlas_tiles) :
+	cache(tileset, size_t(atlas_tiles) * atlas_tiles, max<size_t>(get_worker_count() - 1, 1)),
+	mesh_min(mesh_min), mesh_max(mesh_max), atlas_tiles(atlas_tiles),
+	page_cols(tileset.get_cols(0)), page_rows(tileset.get_rows(0)),
+	pages(size_t(page_cols) * page_rows * 4, 0)
+{
+	int atlas_size = atlas_tiles * tileset.tile_size;
+	GLint max_size = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+	if (atlas_size > max_size || page_cols > max_size || page_rows > max_size)
+	{
+		cout << "Orthophoto atlas of " << atlas_size << " pixels or page table of " << page_cols << " x "
+			<< page_rows << " exceeds GL_MAX_TEXTURE_SIZE " << max_size << endl;
+	}
+
+	// no mipmaps, the pyramid levels of the tileset take their place
+	glGenTextures(1, &atlas);
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas_size, atlas_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenTextures(1, &page_table);
+	glBindTexture(GL_TEXTURE_2D, page_table);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, page_cols, page_rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, pages.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Virtual_texture::~Virtual_texture()
+{
+	glDeleteTextures(1, &atlas);
+	glDeleteTextures(1, &page_table);
+}
+
+// Selects the tiles the view needs, copies a few decoded tiles into the atlas and updates the page table.
+// camera_position is in normalized mesh coordinates and mesh_to_clip maps them to clip space.
+// Call once per drawn frame on the GL thread.
+void Virtual_texture::update(const glm::vec3& camera_position, const glm::mat4& mesh_to_clip, float projection_scale)
+{
+	cache.begin_frame();
+	cache.request_visible(camera_position, mesh_to_clip, projection_scale, mesh_min, mesh_max);
+
+	int tile_size = cache.get_tileset().tile_size;
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	vector<Tile_key> changed = cache.commit(TILES_PER_FRAME, [this, tile_size](int slot, const vector<unsigned char>& pixels)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % atlas_tiles) * tile_size, (slot / atlas_tiles) * tile_size,
+			tile_size, tile_size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	});
+	if (changed.empty())
+	{
+		return;
+	}
+
+	for (const Tile_key& key : changed)
+	{
+		_update_pages(key);
+	}
+	glBindTexture(GL_TEXTURE_2D, page_table);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, page_cols, page_rows, GL_RGBA, GL_UNSIGNED_BYTE, pages.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Binds the atlas and page table to texture units 0 and 1 and sets the uniforms of the ORTHOPHOTO shader variant
+void Virtual_texture::bind(const Shader& shader) const
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, page_table);
+	glActiveTexture(GL_TEXTURE0);
+
+	// image coordinates of the normalized mesh position, u to the east and v to the south
+	const Tileset& tileset = cache.get_tileset();
+	glm::dvec3 half_extent = (mesh_max - mesh_min) * 0.5;
+	glm::dvec3 center = mesh_min + half_extent;
+	double image_width = tileset.width * tileset.pixel_size_x;
+	double image_height = tileset.height * tileset.pixel_size_y;
+	shader.set_vec2("uvScale", float(half_extent.x / image_width), float(half_extent.y / image_height));
+	shader.set_vec2("uvOffset", float((center.x - tileset.origin_x) / image_width),
+		float((center.y - tileset.origin_y) / image_height));
+
+	shader.set_int("orthophotoAtlas", 0);
+	shader.set_int("orthophotoPages", 1);
+	shader.set_vec2("pageScale", float(tileset.width) / tileset.tile_size, float(tileset.height) / tileset.tile_size);
+	shader.set_float("atlasTiles", float(atlas_tiles));
+	shader.set_float("tileSize", float(tileset.tile_size));
+}
+
+// Returns whether tiles the view needs are still being decoded
+bool Virtual_texture::is_loading() const
+{
+	return cache.is_busy();
+}
+
+void Virtual_texture::print_statistics() const
+{
+	cache.print_statistics();
+}
+
+void Virtual_texture::_update_pages(const Tile_key& key)
+{
+	// every page under the tile points to the finest resident tile covering it
+	int levels = cache.get_tileset().levels;
+	int col_end = min(page_cols, (key.col + 1) << key.level);
+	int row_end = min(page_rows, (key.row + 1) << key.level);
+	for (int row = key.row << key.level; row < row_end; ++row)
+	{
+		for (int col = key.col << key.level; col < col_end; ++col)
+		{
+			unsigned char* page = &pages[(size_t(row) * page_cols + col) * 4];
+			fill(page, page + 4, 0);
+			for (int level = 0; level < levels; ++level)
+			{
+				int slot = cache.find(Tile_key{ level, col >> level, row >> level });
+				if (slot >= 0)
+				{
+					page[0] = (unsigned char)(slot % atlas_tiles);
+					page[1] = (unsigned char)(slot / atlas_tiles);
+					page[2] = (unsigned char)level;
+					page[3] = 255;
+					break;
+				}
+			}
+		}
+	}
+}
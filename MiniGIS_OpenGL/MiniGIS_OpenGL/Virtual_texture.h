@@ -0,0 +1,55 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "Shader.h"
+#include "Tile_cache.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Drapes a tiled orthophoto over the terrain. Resident tiles share one atlas texture, a page table texture holds for
+// every full resolution tile of the image the atlas position and level of the finest resident tile covering it.
+// Texture coordinates follow from the georeferenced xy position of the vertices, see the ORTHOPHOTO shader variant.
+class Virtual_texture
+{
+public:
+	// tiles per side of the atlas
+	static const int DEFAULT_ATLAS_TILES = 16;
+
+	// Creates the atlas and page table textures and starts the tile decoders. mesh_min and mesh_max are the world
+	// extent of the normalized mesh. Must be called on the GL thread.
+	Virtual_texture(const Tileset& tileset, const glm::dvec3& mesh_min, const glm::dvec3& mesh_max,
+		int atlas_tiles = DEFAULT_ATLAS_TILES);
+	~Virtual_texture();
+
+	Virtual_texture(const Virtual_texture&) = delete;
+	Virtual_texture& operator=(const Virtual_texture&) = delete;
+
+	// Selects the tiles the view needs, copies a few decoded tiles into the atlas and updates the page table.
+	// camera_position is in normalized mesh coordinates and mesh_to_clip maps them to clip space.
+	// Call once per drawn frame on the GL thread.
+	void update(const glm::vec3& camera_position, const glm::mat4& mesh_to_clip, float projection_scale);
+
+	// Binds the atlas and page table to texture units 0 and 1 and sets the uniforms of the ORTHOPHOTO shader variant
+	void bind(const Shader& shader) const;
+
+	// Returns whether tiles the view needs are still being decoded
+	bool is_loading() const;
+
+	void print_statistics() const;
+
+private:
+	Tile_cache cache;
+	glm::dvec3 mesh_min;
+	glm::dvec3 mesh_max;
+	int atlas_tiles;
+	unsigned int atlas;
+	unsigned int page_table;
+	int page_cols;
+	int page_rows;
+	// RGBA per page: atlas column, atlas row, level, resident
+	std::vector<unsigned char> pages;
+
+	void _update_pages(const Tile_key& key);
+};
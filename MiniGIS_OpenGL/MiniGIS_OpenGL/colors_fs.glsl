@@ -3,31 +3,79 @@ out vec4 FragColor;
 
 in vec3 Normal;  
 in vec3 FragPos;  
+#ifdef DIFFERENCE_COLORS
+in vec3 Color;
+#else
+in float AmbientOcclusion;
+in float Hillshade;
+#endif
+#ifdef ORTHOPHOTO
+in vec2 TexCoord;
+#endif
   
 uniform vec3 lightPos; 
 uniform vec3 viewPos; 
 uniform vec3 lightColor;
 uniform vec3 objectColor;
 
+#ifdef ORTHOPHOTO
+uniform sampler2D orthophotoAtlas;
+uniform sampler2D orthophotoPages;
+// full resolution tiles across and down the image
+uniform vec2 pageScale;
+uniform float atlasTiles;
+uniform float tileSize;
+
+// color of the orthophoto, the object color outside of the image or where no tile is resident yet
+vec3 orthophoto_color()
+{
+    if (any(lessThan(TexCoord, vec2(0.0))) || any(greaterThanEqual(TexCoord, vec2(1.0))))
+    {
+        return objectColor;
+    }
+    vec2 page = TexCoord * pageScale;
+    vec4 entry = floor(texelFetch(orthophotoPages, ivec2(page), 0) * 255.0 + 0.5);
+    if (entry.a == 0.0)
+    {
+        return objectColor;
+    }
+    // stay half a texel inside the tile, so filtering does not reach its neighbours in the atlas
+    vec2 inTile = clamp(fract(page / exp2(entry.b)), 0.5 / tileSize, 1.0 - 0.5 / tileSize);
+    return texture(orthophotoAtlas, (entry.xy + inTile) / atlasTiles).rgb;
+}
+#endif
+
 void main()
 {
-    // ambient
-    float ambientStrength = 0.1;
-    vec3 ambient = ambientStrength * lightColor;
-  	
-    // diffuse 
     vec3 norm = normalize(Normal);
     vec3 lightDir = normalize(lightPos - FragPos);
+
+#ifdef DIFFERENCE_COLORS
+    // ambient and two sided diffuse only, so the difference colors stay readable from below
+    vec3 ambient = 0.3 * lightColor;
+    vec3 diffuse = 0.7 * abs(dot(norm, lightDir)) * lightColor;
+    FragColor = vec4((ambient + diffuse) * Color, 1.0);
+#else
+    // ambient, darkened in creases by the baked occlusion
+    float ambientStrength = 0.3;
+    vec3 ambient = ambientStrength * AmbientOcclusion * lightColor;
+  	
+    // diffuse, blended with the baked sun hillshade
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * lightColor;
+    vec3 diffuse = mix(diff, Hillshade, 0.6) * lightColor;
     
     // specular
     float specularStrength = 0.5;
     vec3 viewDir = normalize(viewPos - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);  
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec3 specular = specularStrength * spec * lightColor;  
+    vec3 specular = specularStrength * spec * AmbientOcclusion * lightColor;  
         
+#ifdef ORTHOPHOTO
+    vec3 result = (ambient + diffuse + specular) * orthophoto_color();
+#else
     vec3 result = (ambient + diffuse + specular) * objectColor;
+#endif
     FragColor = vec4(result, 1.0);
-} 
\ No newline at end of file
+#endif
+}
@@ -1,18 +1,46 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
+#ifdef DIFFERENCE_COLORS
+layout (location = 2) in vec3 aColor;
+#else
+layout (location = 2) in vec2 aRelief;
+#endif
 
 out vec3 FragPos;
 out vec3 Normal;
+#ifdef DIFFERENCE_COLORS
+out vec3 Color;
+#else
+out float AmbientOcclusion;
+out float Hillshade;
+#endif
+#ifdef ORTHOPHOTO
+out vec2 TexCoord;
+#endif
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+#ifdef ORTHOPHOTO
+// maps the normalized mesh position to orthophoto image coordinates
+uniform vec2 uvScale;
+uniform vec2 uvOffset;
+#endif
 
 void main()
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;  
+#ifdef DIFFERENCE_COLORS
+    Color = aColor;
+#else
+    AmbientOcclusion = aRelief.x;
+    Hillshade = aRelief.y;
+#endif
+#ifdef ORTHOPHOTO
+    TexCoord = aPos.xy * uvScale + uvOffset;
+#endif
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+}
@@ -12,12 +12,30 @@
 
 #include "Shader.h"
 #include "Camera.h"
+#include "Memory_usage.h"
+#include "Mesh_exporter.h"
+#include "Parallel.h"
+#include "Point_cloud.h"
+#include "Point_octree.h"
+#include "Point_renderer.h"
+#include "Redraw_scheduler.h"
+#include "Relief_baker.h"
+#include "Survey_comparison.h"
+#include "Upload_stream.h"
+#include "Virtual_texture.h"
 
 #include <iostream>
 #include <vector>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <thread>
 #include <windows.h>
 #include <Commdlg.h>
 
@@ -37,11 +55,19 @@ using namespace std;
 using namespace glm;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void window_refresh_callback(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double x_pos, double y_pos);
 void scroll_callback(GLFWwindow* window, double x_offset, double y_offset);
-void process_input(GLFWwindow* window);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+bool process_input(GLFWwindow* window);
 unsigned int load_texture(const char* path);
-vector<float> read_from_file();
+string open_file_dialog();
+string save_file_dialog();
+vector<float> read_from_file(const string& path, const vector<uint8_t>& classes, glm::dvec3& bounds_min, glm::dvec3& bounds_max);
+vector<float> compare_surveys(const char* before_path, const char* after_path, double cell_size, const vector<uint8_t>& classes);
+void benchmark_read(const vector<string>& paths, const vector<uint8_t>& classes);
+void benchmark_tiles(const string& directory);
+void benchmark_octree(const vector<size_t>& counts);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -56,10 +82,16 @@ bool first_mouse = true;
 // timing
 float delta_time = 0.0f;
 float last_frame = 0.0f;
+Redraw_scheduler scheduler;
 
 // lighting
 glm::vec3 light_pos(0.0f, 0.0f, 3.0f);
 
+// export, requested with the E key
+bool export_requested = false;
+// raw points instead of the mesh, toggled with the P key
+bool show_points = false;
+
 extern "C"
 {
     __declspec(dllexport) unsigned long NvOptimusEnablement = 0x00000001;
@@ -68,9 +100,141 @@ extern "C"
 float lr_angle = 360.0f;
 float ud_angle = 360.0f;
 bool lr_direction = true;
+// model rotation in radians per second
+const float ROTATION_SPEED = 0.6f;
 
-int main()
+int main(int argc, char* argv[])
 {
+    // survey comparison: MiniGIS_OpenGL --compare <before> <after> [--cell-size <size>] [--headless]
+    // mesh export:      MiniGIS_OpenGL [--input <points>] --export <mesh.ply|mesh.glb> [--headless]
+    // read throughput:  MiniGIS_OpenGL --benchmark-read <file>...
+    // tile streaming:   MiniGIS_OpenGL --benchmark-tiles <tileset directory>
+    // point octree:     MiniGIS_OpenGL --benchmark-octree <point count>...
+    // --orthophoto <tileset directory> drapes a tiled orthophoto over the terrain, see Tileset for the layout
+    // --classes <class,class,...> keeps only these classifications of LAS files, e.g. --classes 2 for ground
+    // --keep-mesh keeps the CPU copy of the mesh after it is uploaded, so the viewer can export it with the E key
+    bool compare_mode = argc >= 4 && string(argv[1]) == "--compare";
+    bool headless = false;
+    bool keep_mesh = false;
+    double cell_size = 0.0;
+    vector<uint8_t> classes;
+    vector<string> benchmark_paths;
+    vector<size_t> benchmark_octree_counts;
+    string input_path;
+    string export_path;
+    string orthophoto_path;
+    string benchmark_tiles_path;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (string(argv[i]) == "--headless")
+        {
+            headless = true;
+        }
+        else if (string(argv[i]) == "--keep-mesh")
+        {
+            keep_mesh = true;
+        }
+        else if (string(argv[i]) == "--input" && i + 1 < argc)
+        {
+            input_path = argv[++i];
+        }
+        else if (string(argv[i]) == "--export" && i + 1 < argc)
+        {
+            export_path = argv[++i];
+        }
+        else if (string(argv[i]) == "--orthophoto" && i + 1 < argc)
+        {
+            orthophoto_path = argv[++i];
+        }
+        else if (string(argv[i]) == "--benchmark-tiles" && i + 1 < argc)
+        {
+            benchmark_tiles_path = argv[++i];
+        }
+        else if (string(argv[i]) == "--cell-size" && i + 1 < argc)
+        {
+            cell_size = atof(argv[++i]);
+        }
+        else if (string(argv[i]) == "--classes" && i + 1 < argc)
+        {
+            stringstream list(argv[++i]);
+            string point_class;
+            while (getline(list, point_class, ','))
+            {
+                classes.push_back(uint8_t(atoi(point_class.c_str())));
+            }
+        }
+        else if (string(argv[i]) == "--benchmark-read")
+        {
+            while (i + 1 < argc && string(argv[i + 1]).compare(0, 2, "--") != 0)
+            {
+                benchmark_paths.push_back(argv[++i]);
+            }
+        }
+        else if (string(argv[i]) == "--benchmark-octree")
+        {
+            while (i + 1 < argc && string(argv[i + 1]).compare(0, 2, "--") != 0)
+            {
+                benchmark_octree_counts.push_back(size_t(atof(argv[++i])));
+            }
+        }
+    }
+
+    if (!benchmark_paths.empty())
+    {
+        benchmark_read(benchmark_paths, classes);
+        return 0;
+    }
+    if (!benchmark_tiles_path.empty())
+    {
+        benchmark_tiles(benchmark_tiles_path);
+        return 0;
+    }
+    if (!benchmark_octree_counts.empty())
+    {
+        benchmark_octree(benchmark_octree_counts);
+        return 0;
+    }
+
+    vector<float> vertices;
+    // floats per vertex: position and normal, plus the difference color in comparison mode
+    // or the baked ambient occlusion and hillshade otherwise
+    int stride = compare_mode ? 9 : 8;
+    // world extent of the normalized vertices; the difference surface is exported as it is drawn
+    glm::dvec3 mesh_min(-1.0), mesh_max(1.0);
+    // the raw points for the point view, read again and indexed when they are first shown
+    unique_ptr<Point_octree> octree;
+    if (compare_mode)
+    {
+        vertices = compare_surveys(argv[2], argv[3], cell_size, classes);
+        report_memory("comparison");
+    }
+    else
+    {
+        if (input_path.empty())
+        {
+            input_path = open_file_dialog();
+        }
+        vertices = read_from_file(input_path, classes, mesh_min, mesh_max);
+        if (headless)
+        {
+            // the relief is only needed for drawing
+            stride = 6;
+        }
+        else
+        {
+            vertices = bake_relief(vertices);
+            report_memory("relief baking");
+        }
+    }
+    if (!export_path.empty())
+    {
+        export_mesh(export_path, vertices, stride, mesh_min, mesh_max);
+    }
+    if (headless)
+    {
+        return 0;
+    }
+
     // glfw: initialize and configure
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -88,6 +252,8 @@ int main()
     }
 
     glfwMakeContextCurrent(window);
+    // pace frames to the display while keys are held
+    glfwSwapInterval(1);
     glewExperimental = GL_TRUE;
     GLenum error = glewInit();
 
@@ -100,8 +266,10 @@ int main()
 
 
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -110,37 +278,117 @@ int main()
     glEnable(GL_DEPTH_TEST);
 
     // build and compile our shader program
-    Shader lighting_shader("colors_vs.glsl", "colors_fs.glsl"); 
-
-    vector<float> vertices = read_from_file();
-
-    // first, configure the cube's VAO (and VBO)
-    unsigned int VBO, cube_VAO;
+    // the comparison uses the variant with per-vertex difference colors, an orthophoto the draping variant
+    vector<string> shader_defines;
+    Tileset tileset;
+    size_t atlas_slots = size_t(Virtual_texture::DEFAULT_ATLAS_TILES) * Virtual_texture::DEFAULT_ATLAS_TILES;
+    if (compare_mode)
+    {
+        shader_defines.push_back("DIFFERENCE_COLORS");
+    }
+    else if (!orthophoto_path.empty() && tileset.load(orthophoto_path, atlas_slots))
+    {
+        shader_defines.push_back("ORTHOPHOTO");
+    }
+    Shader lighting_shader("colors_vs.glsl", "colors_fs.glsl", nullptr, shader_defines);
+    unique_ptr<Virtual_texture> orthophoto;
+    if (find(shader_defines.begin(), shader_defines.end(), "ORTHOPHOTO") != shader_defines.end())
+    {
+        orthophoto.reset(new Virtual_texture(tileset, mesh_min, mesh_max));
+    }
+    // created when the points are first shown, until then the positions stay off the device
+    unique_ptr<Point_renderer> point_renderer;
+
+    // first, configure the cube's VAO (and VBO), the vertices are streamed into the VBO over the next frames.
+    // The CPU copy is released once uploaded, unless --keep-mesh keeps it for exporting.
+    shared_ptr<const vector<float>> mesh_vertices = make_shared<const vector<float>>(move(vertices));
+    unique_ptr<Upload_stream> mesh_upload(new Upload_stream(mesh_vertices));
+    unsigned int cube_VAO;
     glGenVertexArrays(1, &cube_VAO);
-    glGenBuffers(1, &VBO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh_upload->get_buffer());
 
     glBindVertexArray(cube_VAO);
 
     // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
     // normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
+    if (compare_mode)
+    {
+        // difference color attribute
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+    }
+    else
+    {
+        // baked relief attribute
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+    }
+
 
+    // uniforms that do not change between frames
+    lighting_shader.use();
+    lighting_shader.set_vec3("objectColor", 1.0f, 0.5f, 0.31f);
+    lighting_shader.set_vec3("lightColor", 1.0f, 1.0f, 1.0f);
+    lighting_shader.set_vec3("lightPos", light_pos);
 
+    // the upload report is printed once, also for an empty mesh or a window closed while uploading
+    bool upload_reported = false;
+    scheduler.reset_statistics();
     while (!glfwWindowShouldClose(window))
     {
-        // per-frame time logic
+        // sleeps while nothing changes, polls while something is animated
+        scheduler.wait_events();
+
+        // per-frame time logic, the first frame after an idle wait does not move anything
         float currentFrame = glfwGetTime();
-        delta_time = currentFrame - last_frame;
+        delta_time = scheduler.is_animating() ? currentFrame - last_frame : 0.0f;
         last_frame = currentFrame;
 
-        // input
-        process_input(window);
+        if (export_requested)
+        {
+            export_requested = false;
+            if (!mesh_vertices)
+            {
+                cout << "The mesh was released after uploading, start with --keep-mesh to export it from the viewer" << endl;
+            }
+            else
+            {
+                glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+                string path = save_file_dialog();
+                if (!path.empty())
+                {
+                    export_mesh(path, *mesh_vertices, stride, mesh_min, mesh_max);
+                }
+                glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+                first_mouse = true;
+            }
+        }
+
+        // input, keep drawing while the mesh or the shown points are still uploading or orthophoto tiles are still decoding
+        bool uploading = !mesh_upload->is_finished() || (show_points && point_renderer && point_renderer->is_uploading());
+        bool loading_tiles = orthophoto && orthophoto->is_loading();
+        scheduler.set_animating(process_input(window) || uploading || loading_tiles);
+        if (!scheduler.should_draw())
+        {
+            continue;
+        }
+
+        mesh_upload->pump();
+        if (!upload_reported && mesh_upload->is_finished())
+        {
+            upload_reported = true;
+            mesh_upload->print_statistics();
+            if (!keep_mesh)
+            {
+                mesh_vertices.reset();
+            }
+            report_memory("upload");
+        }
 
         // render
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -148,9 +396,6 @@ int main()
 
         // be sure to activate shader when setting uniforms/drawing objects
         lighting_shader.use();
-        lighting_shader.set_vec3("objectColor", 1.0f, 0.5f, 0.31f);
-        lighting_shader.set_vec3("lightColor", 1.0f, 1.0f, 1.0f);
-        lighting_shader.set_vec3("lightPos", light_pos);
         lighting_shader.set_vec3("viewPos", camera.get_position());
 
         // view/projection transformations
@@ -158,6 +403,8 @@ int main()
         glm::mat4 view = camera.get_view_matrix();
         lighting_shader.set_mat4("projection", projection);
         lighting_shader.set_mat4("view", view);
+        // screen pixels per unit at distance 1, the level of detail of tiles and points follows from it
+        float projection_scale = SCR_HEIGHT / (2.0f * tan(glm::radians(camera.get_zoom()) / 2.0f));
 
         // world transformation
         glm::mat4 model = glm::mat4(1.0f);
@@ -165,43 +412,100 @@ int main()
         model = glm::rotate(model, ud_angle, glm::vec3(1, 0, 0));
         lighting_shader.set_mat4("model", model);
 
-        // render the cube
-        glBindVertexArray(cube_VAO);
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+        if (orthophoto)
+        {
+            // tiles are chosen in mesh coordinates, at the detail the distance to the camera needs
+            glm::vec3 camera_in_mesh = glm::vec3(glm::inverse(model) * glm::vec4(camera.get_position(), 1.0f));
+            orthophoto->update(camera_in_mesh, projection * view * model, projection_scale);
+            orthophoto->bind(lighting_shader);
+        }
+
+        // the raw points are read again and indexed when they are first shown, so a session that only looks at the
+        // surface neither reads the input twice nor keeps the index
+        if (show_points && !octree && !compare_mode)
+        {
+            vector<glm::dvec3> points = read_points(input_path, classes);
+            if (points.empty())
+            {
+                cout << "No points to show: " << input_path << endl;
+                show_points = false;
+            }
+            else
+            {
+                octree.reset(new Point_octree(points));
+                report_memory("octree");
+            }
+        }
+        if (show_points && octree && !point_renderer)
+        {
+            point_renderer.reset(new Point_renderer(*octree, mesh_min, mesh_max));
+        }
+        if (show_points && point_renderer)
+        {
+            point_renderer->draw(model, view, projection, projection_scale);
+        }
+        else
+        {
+            // render the cube, only the whole triangles that are uploaded so far
+            size_t uploaded_vertices = mesh_upload->get_uploaded_bytes() / (stride * sizeof(float));
+            glBindVertexArray(cube_VAO);
+            glDrawArrays(GL_TRIANGLES, 0, uploaded_vertices - uploaded_vertices % 3);
+        }
 
 
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+        // glfw: swap buffers, IO events are processed by the scheduler at the start of the next frame
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        scheduler.frame_drawn();
+    }
+    scheduler.print_statistics();
+    if (!upload_reported)
+    {
+        mesh_upload->print_statistics();
+    }
+    if (orthophoto)
+    {
+        orthophoto->print_statistics();
+    }
+    if (point_renderer)
+    {
+        point_renderer->print_statistics();
     }
     // optional: de-allocate all resources once they've outlived their purpose:
     glDeleteVertexArrays(1, &cube_VAO);
-    glDeleteBuffers(1, &VBO);
+    mesh_upload.reset();
+    orthophoto.reset();
+    point_renderer.reset();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     glfwTerminate();
     return 0;
 }
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-void process_input(GLFWwindow* window)
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly.
+// Returns whether a held key changed the view, so the next frame has to be drawn as well.
+bool process_input(GLFWwindow* window)
 {
+    bool changed = false;
     if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
     {
-        lr_angle += 0.01;
+        lr_angle += ROTATION_SPEED * delta_time;
+        changed = true;
     }
     else if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
     {
-        lr_angle -= 0.01;
+        lr_angle -= ROTATION_SPEED * delta_time;
+        changed = true;
     }
 
     if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
     {
-        ud_angle += 0.01;
+        ud_angle += ROTATION_SPEED * delta_time;
+        changed = true;
     }
     else if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
     {
-        ud_angle -= 0.01;
+        ud_angle -= ROTATION_SPEED * delta_time;
+        changed = true;
     }
 
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -212,19 +516,24 @@ void process_input(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
     {
         camera.process_keyboard(Camera_Movement::FORWARD, delta_time);
+        changed = true;
     }
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
     {
         camera.process_keyboard(Camera_Movement::BACKWARD, delta_time);
+        changed = true;
     }
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
     {
         camera.process_keyboard(Camera_Movement::LEFT, delta_time);
+        changed = true;
     }
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
     {
         camera.process_keyboard(Camera_Movement::RIGHT, delta_time);
+        changed = true;
     }
+    return changed;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -233,6 +542,27 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    scheduler.request_redraw();
+}
+
+// glfw: whenever a key is pressed or released, this callback is called. Held keys are handled in process_input.
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (key == GLFW_KEY_E && action == GLFW_PRESS)
+    {
+        export_requested = true;
+    }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+    {
+        show_points = !show_points;
+        scheduler.request_redraw();
+    }
+}
+
+// glfw: whenever the window contents are damaged (e.g. uncovered by another window), this callback is called
+void window_refresh_callback(GLFWwindow* window)
+{
+    scheduler.request_redraw();
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -252,12 +582,14 @@ void mouse_callback(GLFWwindow* window, double x_pos, double y_pos)
     last_y = y_pos;
 
     camera.process_mouse_movement(x_offset, y_offset);
+    scheduler.request_redraw();
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 void scroll_callback(GLFWwindow* window, double x_offset, double y_offset)
 {
     camera.process_mouse_scroll(y_offset);
+    scheduler.request_redraw();
 }
 
 // utility function for loading a 2D texture from file
@@ -304,7 +636,7 @@ unsigned int load_texture(char const* path)
     return texture_ID;
 }
 
-vector<float> read_from_file()
+string open_file_dialog()
 {
     // Open file
     wchar_t file_size[1024];
@@ -315,7 +647,7 @@ vector<float> read_from_file()
     ofn.lpstrFile = file_size;
     ofn.lpstrFile[0] = '\0';
     ofn.nMaxFile = sizeof(file_size);
-    ofn.lpstrFilter = L"All\0*.*\0Text\0*.TXT\0";
+    ofn.lpstrFilter = L"All\0*.*\0Text\0*.TXT\0LAS\0*.LAS\0";
     ofn.nFilterIndex = 1;
     ofn.lpstrFileTitle = NULL;
     ofn.nMaxFileTitle = 0;
@@ -323,74 +655,286 @@ vector<float> read_from_file()
     ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
     GetOpenFileName(&ofn);
 
+    char path[1024];
+    WideCharToMultiByte(CP_ACP, 0, ofn.lpstrFile, -1, path, sizeof(path), NULL, NULL);
+    return path;
+}
+
+string save_file_dialog()
+{
+    wchar_t file_name[1024];
+    OPENFILENAME ofn;
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = NULL;
+    ofn.lpstrFile = file_name;
+    ofn.lpstrFile[0] = '\0';
+    ofn.nMaxFile = sizeof(file_name) / sizeof(wchar_t);
+    ofn.lpstrFilter = L"glTF binary\0*.GLB\0PLY\0*.PLY\0";
+    ofn.nFilterIndex = 1;
+    ofn.lpstrDefExt = L"glb";
+    ofn.Flags = OFN_PATHMUSTEXIST | OFN_OVERWRITEPROMPT;
+    if (!GetSaveFileName(&ofn))
+    {
+        return string();
+    }
+
+    char path[1024];
+    WideCharToMultiByte(CP_ACP, 0, ofn.lpstrFile, -1, path, sizeof(path), NULL, NULL);
+    return path;
+}
+
+vector<float> read_from_file(const string& path, const vector<uint8_t>& classes, glm::dvec3& bounds_min, glm::dvec3& bounds_max)
+{
     // mesh generation
     // https://cgal.geometryfactory.com/CGAL/doc/master/Advancing_front_surface_reconstruction/index.html#Chapter_Advancing_Front_Surface_Reconstruction
     // File Advancing_front_surface_reconstruction/reconstruction_class.cpp
     vector<float> vertices;
-    float max_x = 0, max_y = 0, max_z = 0;
-    float min_x = 1e9, min_y = 1e9, min_z = 1e9;
-    vertices.clear();
-    std::ifstream in(ofn.lpstrFile);
-    std::istream_iterator<Point_3> begin(in);
-    std::istream_iterator<Point_3> end;
-    Triangulation_3 dt(begin, end);
-    Reconstruction reconstruction(dt);
-    reconstruction.run();
-    const TDS_2& tds = reconstruction.triangulation_data_structure_2();
-    std::cout << "solid produced with CGAL::Advancing_front_surface_reconstruction\n";
-    int count = 0;
-    for (TDS_2::Face_iterator fit = tds.faces_begin();
-        fit != tds.faces_end();
-        ++fit) {
-        if (reconstruction.has_on_surface(fit)) {
+    {
+        vector<Point_3> input_points;
+        {
+            vector<glm::dvec3> input = read_points(path, classes);
+            report_memory("reading points");
+            input_points.reserve(input.size());
+            for (const glm::dvec3& point : input)
+            {
+                input_points.push_back(Point_3(point.x, point.y, point.z));
+            }
+        }
+        // the triangulation keeps its own copy of the points
+        Triangulation_3 dt(input_points.begin(), input_points.end());
+        vector<Point_3>().swap(input_points);
+        report_memory("triangulation");
+        Reconstruction reconstruction(dt);
+        reconstruction.run();
+        const TDS_2& tds = reconstruction.triangulation_data_structure_2();
+        std::cout << "solid produced with CGAL::Advancing_front_surface_reconstruction\n";
+        report_memory("reconstruction");
+
+        auto get_facet_points = [](TDS_2::Face_iterator fit, glm::dvec3 points[3])
+        {
             Triangulation_3::Facet f = fit->facet();
             Triangulation_3::Cell_handle ch = f.first;
             int ci = f.second;
-            Point_3 points[3];
             for (int i = 0, j = 0; i < 4; i++) {
                 if (ci != i) {
-                    points[j] = ch->vertex(i)->point();
+                    const Point_3& point = ch->vertex(i)->point();
+                    points[j] = glm::dvec3(point.x(), point.y(), point.z());
                     j++;
                 }
             }
-            // calculating normal
-            glm::vec3 v1(points[0].x(), points[0].y(), points[0].z());
-            glm::vec3 v2(points[1].x(), points[1].y(), points[1].z());
-            glm::vec3 v3(points[2].x(), points[2].y(), points[2].z());
-            glm::vec3 f1 = v2 - v1;
-            glm::vec3 f2 = v3 - v1;
-            glm::vec3 n = glm::cross(f1, f2);
-            n = glm::normalize(n);
-
-            for (int i = 0; i < 3; ++i)
-            {
-                vertices.push_back(points[i].x());
-                if (vertices[count] > max_x) max_x = vertices[count];
-                if (vertices[count] < min_x) min_x = vertices[count];
-                count++;
-                vertices.push_back(points[i].y());
-                if (vertices[count] > max_y) max_y = vertices[count];
-                if (vertices[count] < min_y) min_y = vertices[count];
-                count++;
-                vertices.push_back(points[i].z());
-                if (vertices[count] > max_z) max_z = vertices[count];
-                if (vertices[count] < min_z) min_z = vertices[count];
-                count++;
-                vertices.push_back(n.x);
-                vertices.push_back(n.y);
-                vertices.push_back(n.z);
-                count += 3;
+        };
+
+        // the first pass counts the surface facets and finds their extent, so the vertices are allocated exactly once
+        size_t facet_count = 0;
+        bounds_min = glm::dvec3(numeric_limits<double>::max());
+        bounds_max = glm::dvec3(-numeric_limits<double>::max());
+        glm::dvec3 points[3];
+        for (TDS_2::Face_iterator fit = tds.faces_begin(); fit != tds.faces_end(); ++fit) {
+            if (reconstruction.has_on_surface(fit)) {
+                get_facet_points(fit, points);
+                for (int i = 0; i < 3; ++i)
+                {
+                    bounds_min = glm::min(bounds_min, points[i]);
+                    bounds_max = glm::max(bounds_max, points[i]);
+                }
+                ++facet_count;
             }
+        }
 
+        // the second pass writes the positions normalized to [-1, 1] and the facet normal. Both are computed in double,
+        // georeferenced coordinates lose too much in a float before they are normalized.
+        glm::dvec3 scale = 2.0 / glm::max(bounds_max - bounds_min, glm::dvec3(1e-12));
+        vertices.resize(facet_count * 3 * 6);
+        float* vertex = vertices.data();
+        for (TDS_2::Face_iterator fit = tds.faces_begin(); fit != tds.faces_end(); ++fit) {
+            if (reconstruction.has_on_surface(fit)) {
+                get_facet_points(fit, points);
+                // calculating normal
+                glm::dvec3 n = glm::normalize(glm::cross(points[1] - points[0], points[2] - points[0]));
+                for (int i = 0; i < 3; ++i)
+                {
+                    glm::dvec3 position = (points[i] - bounds_min) * scale - 1.0;
+                    *vertex++ = float(position.x);
+                    *vertex++ = float(position.y);
+                    *vertex++ = float(position.z);
+                    *vertex++ = float(n.x);
+                    *vertex++ = float(n.y);
+                    *vertex++ = float(n.z);
+                }
+            }
         }
     }
+    report_memory("meshing");
+    return vertices;
+}
 
-    int a = -1, b = 1;
-    for (int i = 0; i < vertices.size(); i += 3)
+vector<float> compare_surveys(const char* before_path, const char* after_path, double cell_size, const vector<uint8_t>& classes)
+{
+    auto start = chrono::steady_clock::now();
+    vector<glm::dvec3> before = read_points(before_path, classes);
+    vector<glm::dvec3> after = read_points(after_path, classes);
+    auto read_end = chrono::steady_clock::now();
+
+    Survey_comparison comparison(before, after, cell_size);
+    auto grid_end = chrono::steady_clock::now();
+    Volume_statistics statistics = comparison.compute_statistics();
+    auto statistics_end = chrono::steady_clock::now();
+    vector<float> vertices = comparison.build_difference_mesh();
+    auto mesh_end = chrono::steady_clock::now();
+
+    auto milliseconds = [](chrono::steady_clock::time_point from, chrono::steady_clock::time_point to)
+    {
+        return chrono::duration<double, milli>(to - from).count();
+    };
+    const Height_grid& grid = comparison.get_after();
+    cout << "survey comparison: " << before.size() << " / " << after.size() << " points, "
+        << grid.get_cols() << " x " << grid.get_rows() << " cells of " << grid.get_cell_size() << "\n";
+    if (statistics.cell_count == 0)
     {
-        vertices[i] = (vertices[i] - min_x) * (b - a) / (max_x - min_x) + a;
-        vertices[i + 1] = (vertices[i + 1] - min_y) * (b - a) / (max_y - min_y) + a;
-        vertices[i + 2] = (vertices[i + 2] - min_z) * (b - a) / (max_z - min_z) + a;
+        cout << "the surveys do not overlap" << endl;
+        return vertices;
     }
+    cout << "  cut volume:      " << statistics.cut_volume << " over " << statistics.cut_area << "\n"
+        << "  fill volume:     " << statistics.fill_volume << " over " << statistics.fill_area << "\n"
+        << "  net volume:      " << statistics.fill_volume - statistics.cut_volume << "\n"
+        << "  overlap area:    " << statistics.overlap_area << "\n"
+        << "  difference:      min " << statistics.min_difference << ", max " << statistics.max_difference
+        << ", mean " << statistics.mean_difference << ", rms " << statistics.rms_difference << "\n"
+        << "  timings (ms):    read " << milliseconds(start, read_end) << ", grid " << milliseconds(read_end, grid_end)
+        << ", statistics " << milliseconds(grid_end, statistics_end) << ", mesh " << milliseconds(statistics_end, mesh_end) << endl;
     return vertices;
 }
+
+// reads every file with read_points and reports its throughput, e.g. for a LAS file and its text export
+void benchmark_read(const vector<string>& paths, const vector<uint8_t>& classes)
+{
+    for (const string& path : paths)
+    {
+        ifstream file(path, ios::binary | ios::ate);
+        double megabytes = file ? double(file.tellg()) / (1024.0 * 1024.0) : 0.0;
+        file.close();
+
+        auto start = chrono::steady_clock::now();
+        vector<glm::dvec3> points = read_points(path, classes);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << path << ": " << points.size() << " points, " << megabytes << " MB in " << seconds * 1000.0 << " ms ("
+            << (seconds > 0.0 ? points.size() / seconds / 1e6 : 0.0) << " Mpoints/s, "
+            << (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s)" << endl;
+    }
+}
+
+// Flies a camera low over the tileset without a window, at the frame rate of the viewer, and reports the hit rate
+// of the tile cache and the decode throughput. The terrain is assumed to cover the whole image.
+void benchmark_tiles(const string& directory)
+{
+    const int FRAMES = 600;
+    const float HEIGHT = 0.2f;
+    size_t slot_count = size_t(Virtual_texture::DEFAULT_ATLAS_TILES) * Virtual_texture::DEFAULT_ATLAS_TILES;
+    Tileset tileset;
+    if (!tileset.load(directory, slot_count))
+    {
+        return;
+    }
+
+    double x0 = tileset.origin_x;
+    double x1 = x0 + tileset.width * tileset.pixel_size_x;
+    double y0 = tileset.origin_y;
+    double y1 = y0 + tileset.height * tileset.pixel_size_y;
+    glm::dvec3 mesh_min(std::min(x0, x1), std::min(y0, y1), 0.0);
+    glm::dvec3 mesh_max(std::max(x0, x1), std::max(y0, y1), 1.0);
+
+    Tile_cache cache(tileset, slot_count, std::max<size_t>(get_worker_count() - 1, 1));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    float projection_scale = SCR_HEIGHT / (2.0f * tan(glm::radians(45.0f) / 2.0f));
+    size_t uploaded_tiles = 0;
+    for (int frame = 0; frame < FRAMES; ++frame)
+    {
+        // diagonal flight across the image, looking ahead and down
+        float t = float(frame) / (FRAMES - 1);
+        glm::vec3 position(-1.0f + 2.0f * t, -1.0f + 2.0f * t, HEIGHT);
+        glm::mat4 view = glm::lookAt(position, position + glm::vec3(1.0f, 1.0f, -1.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        cache.begin_frame();
+        cache.request_visible(position, projection * view, projection_scale, mesh_min, mesh_max);
+        cache.commit(8, [&uploaded_tiles](int, const vector<unsigned char>&) { ++uploaded_tiles; });
+        this_thread::sleep_for(chrono::milliseconds(16));
+    }
+    cout << FRAMES << " frames, " << uploaded_tiles << " tiles copied into the atlas" << endl;
+    cache.print_statistics();
+}
+
+// Builds octrees over synthetic terrains of the given sizes and reports the build time and the throughput of box and
+// radius queries. The queries cover about the same area, so larger terrains return more points per query.
+void benchmark_octree(const vector<size_t>& counts)
+{
+    const double EXTENT = 10000.0;
+    const double QUERY_SIZE = 100.0;
+    const int QUERIES = 10000;
+    auto seconds_since = [](chrono::steady_clock::time_point from)
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - from).count();
+    };
+
+    for (size_t count : counts)
+    {
+        try
+        {
+            // rolling hills with a little noise, every chunk has its own generator
+            auto start = chrono::steady_clock::now();
+            vector<glm::dvec3> points(count);
+            parallel_for(0, count, [&points, EXTENT](size_t begin, size_t end, size_t)
+            {
+                mt19937_64 random(begin);
+                uniform_real_distribution<double> coordinate(0.0, EXTENT);
+                uniform_real_distribution<double> noise(-0.5, 0.5);
+                for (size_t i = begin; i < end; ++i)
+                {
+                    double x = coordinate(random);
+                    double y = coordinate(random);
+                    points[i] = glm::dvec3(x, y, 50.0 * sin(x / 500.0) * cos(y / 700.0) + noise(random));
+                }
+            });
+            double generate_seconds = seconds_since(start);
+
+            start = chrono::steady_clock::now();
+            Point_octree octree(points);
+            double build_seconds = seconds_since(start);
+            vector<glm::dvec3>().swap(points);
+            cout << count << " points: generated in " << generate_seconds << " s, octree built in " << build_seconds
+                << " s (" << count / build_seconds / 1e6 << " Mpoints/s), " << octree.get_nodes().size() << " nodes, "
+                << octree.get_memory_bytes() / (1024.0 * 1024.0) << " MB" << endl;
+
+            mt19937_64 random(count);
+            uniform_real_distribution<double> coordinate(0.0, EXTENT - QUERY_SIZE);
+            vector<glm::dvec3> result;
+            size_t found = 0;
+            start = chrono::steady_clock::now();
+            for (int query = 0; query < QUERIES; ++query)
+            {
+                glm::dvec3 box_min(coordinate(random), coordinate(random), -100.0);
+                glm::dvec3 box_max = box_min + glm::dvec3(QUERY_SIZE, QUERY_SIZE, 200.0);
+                result.clear();
+                found += octree.query_box(box_min, box_max, result);
+            }
+            double box_seconds = seconds_since(start);
+            cout << "  box queries: " << QUERIES / box_seconds << " queries/s, " << found / box_seconds / 1e6
+                << " Mpoints/s, " << found / QUERIES << " points per query" << endl;
+
+            found = 0;
+            start = chrono::steady_clock::now();
+            for (int query = 0; query < QUERIES; ++query)
+            {
+                glm::dvec3 center(coordinate(random) + QUERY_SIZE / 2.0, coordinate(random) + QUERY_SIZE / 2.0, 0.0);
+                result.clear();
+                found += octree.query_radius(center, QUERY_SIZE / 2.0, result);
+            }
+            double radius_seconds = seconds_since(start);
+            cout << "  radius queries: " << QUERIES / radius_seconds << " queries/s, " << found / radius_seconds / 1e6
+                << " Mpoints/s, " << found / QUERIES << " points per query" << endl;
+        }
+        catch (const bad_alloc&)
+        {
+            cout << count << " points: not enough memory" << endl;
+        }
+    }
+}
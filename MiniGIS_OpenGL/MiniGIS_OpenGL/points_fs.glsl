@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in float Height;
+
+uniform vec3 lowColor;
+uniform vec3 highColor;
+
+void main()
+{
+    FragColor = vec4(mix(lowColor, highColor, clamp(Height, 0.0, 1.0)), 1.0);
+}
@@ -0,0 +1,18 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+out float Height;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+// maps the octree positions to normalized mesh coordinates
+uniform vec3 pointScale;
+uniform vec3 pointOffset;
+
+void main()
+{
+    vec3 position = aPos * pointScale + pointOffset;
+    Height = position.z * 0.5 + 0.5;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+}